@@ -3,7 +3,9 @@
 
 #include "VirtualFs.h"
 
+#include "ADC.h"
 #include "Client.h"
+#include "ClientManager.h"
 #include "Logs.h"
 #include "Settings.h"
 #include "UserData.h"
@@ -151,6 +153,7 @@ void Bans::initVFS() throw()
 	virtualfs->mknod("/bans/banip", this);
 	virtualfs->mknod("/bans/bannick", this);
 	virtualfs->mknod("/bans/bancid", this);
+	virtualfs->mknod("/bans/find", this);
 	virtualfs->mknod("/bans/list", this);
 }
 
@@ -252,6 +255,8 @@ void Bans::on(Help, const string& cwd, Client* c) throw()
 			"\ttime has the same semantics as Verlihub, except no specifier\n"
 			"\tmeans minutes and 'm' means months\n"
 			"\ttime=0 means unban, time=-1 means forever\n"
+			"find <nick prefix>\t\tshows who's online with a nick starting with that,\n"
+			"\tin any case, and their CID and IP, to ban\n"
 			"list\t\t\t\tshows the list of bans"
 	);
 }
@@ -312,6 +317,25 @@ void Bans::on(Exec, const string& cwd, Client* c, const StringList& arg) throw()
 		} else {
 			c->doPrivateMessage("Syntax: bancid <cid> <time> [description]");
 		}
+	} else if(arg[0] == "find") {
+		if(arg.size() == 2) {
+			// one more than we show, to know there are more
+			vector<sid_type> sids;
+			ClientManager::instance()->findNicks(arg[1], sids, MAX_FOUND + 1);
+			string ret = "Success: users whose nick starts with " + arg[1] + ':';
+			for(vector<sid_type>::size_type i = 0; i < sids.size() && i < MAX_FOUND; ++i) {
+				UserInfo* ui = ClientManager::instance()->getUserInfo(sids[i]);
+				ret += "\n  ";
+				ret += ui->getNick() + " (" + ADC::fromSid(sids[i]) + ") " + ui->getCID();
+				if(ui->has("I4"))
+					ret += ' ' + ui->get("I4");
+			}
+			if(sids.size() > MAX_FOUND)
+				ret += "\n  ...";
+			c->doPrivateMessage(ret);
+		} else {
+			c->doPrivateMessage("Syntax: find <nick prefix>");
+		}
 	} else if(arg[0] == "list") {
 		string ret = "Banned IP addresses:";
 		for(BanList::const_iterator i = ipBans.begin(); i != ipBans.end(); ++i) {
@@ -34,6 +34,9 @@ private:
 	struct BanInfo;	// silly forward declarations...
 	static void killUser(Client*, const BanInfo&) throw();
 
+	// most users find lists
+	static const size_t MAX_FOUND = 50;
+
 	VirtualFs* virtualfs;
 
 	struct BanInfo {
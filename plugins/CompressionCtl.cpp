@@ -0,0 +1,109 @@
+// vim:ts=4:sw=4:noet
+
+#include "CompressionCtl.h"
+
+#include "VirtualFs.h"
+
+#include "Client.h"
+#include "CompressionManager.h"
+#include "Logs.h"
+
+using namespace std;
+using namespace qhub;
+
+/*
+ * Plugin loader/unloader
+ */
+QHUB_PLUGIN(CompressionCtl)
+
+/*
+ * Plugin details
+ */
+UserData::key_type CompressionCtl::idVirtualFs = "virtualfs";
+
+void CompressionCtl::initVFS() throw()
+{
+	virtualfs->mkdir("/compression", this);
+	virtualfs->mknod("/compression/show", this);
+	virtualfs->mknod("/compression/set", this);
+	virtualfs->mknod("/compression/stats", this);
+}
+
+void CompressionCtl::deinitVFS() throw()
+{
+	virtualfs->rmdir("/compression");
+}
+
+void CompressionCtl::on(PluginStarted&, Plugin* p) throw()
+{
+	if(p == this) {
+		virtualfs = (VirtualFs*)Util::data.getVoidPtr(idVirtualFs);
+		if(virtualfs) {
+			Logs::stat << "success: Plugin CompressionCtl: VirtualFs interface found.\n";
+			initVFS();
+		} else {
+			Logs::err << "warning: Plugin CompressionCtl: VirtualFs interface not found.\n";
+		}
+		Logs::stat << "success: Plugin CompressionCtl: Started.\n";
+	} else if(!virtualfs) {
+		virtualfs = (VirtualFs*)Util::data.getVoidPtr(idVirtualFs);
+		if(virtualfs) {
+			Logs::stat << "success: Plugin CompressionCtl: VirtualFs interface found.\n";
+			initVFS();
+		}
+	}
+}
+
+void CompressionCtl::on(PluginStopped&, Plugin* p) throw()
+{
+	if(p == this) {
+		if(virtualfs)
+			deinitVFS();
+		Logs::stat << "success: Plugin CompressionCtl: Stopped.\n";
+	} else if(virtualfs && p == virtualfs) {
+		Logs::err << "warning: Plugin CompressionCtl: VirtualFs interface disabled.\n";
+		virtualfs = NULL;
+	}
+}
+
+void CompressionCtl::on(ChDir, const string&, Client* c) throw()
+{
+	c->doPrivateMessage("This is the compression section."
+			"  See and tune how broadcasts and userlists are compressed here.");
+}
+
+void CompressionCtl::on(Help, const string& cwd, Client* c) throw()
+{
+	assert(cwd == "/compression/");
+	c->doPrivateMessage(
+			"The following commands are available to you:\n"
+			"show\t\t\t\tshows the current settings\n"
+			"set <name> <value>\t\tchanges a setting:\n"
+			"\tlevel, threshold\t\tzlib level (1-9) and smallest batch compressed (bytes), or auto\n"
+			"\tminlevel, maxlevel\t\tlimits for an auto level\n"
+			"\tminthreshold, maxthreshold\tlimits for an auto threshold\n"
+			"\tcpulow, cpuhigh\t\tCPU load (%) under/over which auto settings go up/down\n"
+			"\toffload\t\t\tsmallest batch compressed by a worker thread (bytes)\n"
+			"\tlinks\t\t\t1 to keep new interhub links compressed, 0 not to\n"
+			"stats\t\t\t\tshows what compression has been doing"
+	);
+}
+
+void CompressionCtl::on(Exec, const string& cwd, Client* c, const StringList& arg) throw()
+{
+	assert(arg.size() >= 1);
+	CompressionManager* cm = CompressionManager::instance();
+	if(arg[0] == "show") {
+		c->doPrivateMessage(cm->getSettings());
+	} else if(arg[0] == "set") {
+		if(arg.size() != 3) {
+			c->doPrivateMessage("Usage: set <name> <value>");
+		} else if(!cm->set(arg[1], arg[2])) {
+			c->doPrivateMessage("Unknown setting or bad value (each min has to stay at or under its max).");
+		} else {
+			c->doPrivateMessage(cm->getSettings());
+		}
+	} else if(arg[0] == "stats") {
+		c->doPrivateMessage(cm->getStats());
+	}
+}
@@ -0,0 +1,32 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_PLUGIN_COMPRESSION_CTL_H
+#define QHUB_PLUGIN_COMPRESSION_CTL_H
+
+#include "VirtualFs.h"
+
+namespace qhub {
+
+class CompressionCtl : public Plugin, public VirtualFsListener {
+public:
+	static UserData::key_type idVirtualFs;	// void* (Plugin*)
+
+	CompressionCtl() throw() : Plugin("compressionctl"), virtualfs(NULL) {};
+	virtual ~CompressionCtl() throw() {};
+
+	virtual void on(PluginStarted&, Plugin*) throw();
+	virtual void on(PluginStopped&, Plugin*) throw();
+
+	virtual void on(ChDir, const std::string&, Client*) throw();
+	virtual void on(Help, const std::string&, Client*) throw();
+	virtual void on(Exec, const std::string&, Client*, const StringList&) throw();
+
+private:
+	void initVFS() throw();
+	void deinitVFS() throw();
+
+	VirtualFs* virtualfs;
+};
+
+} //namespace qhub
+
+#endif // QHUB_PLUGIN_COMPRESSION_CTL_H
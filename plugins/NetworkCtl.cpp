@@ -9,6 +9,7 @@
 #include "Hub.h"
 #include "InterHub.h"
 #include "Logs.h"
+#include "ServerManager.h"
 #include "Settings.h"
 #include "XmlTok.h"
 
@@ -32,7 +33,12 @@ void NetworkCtl::initVFS() throw()
 	virtualfs->mkdir("/networkctl", this);
 	virtualfs->mknod("/networkctl/connect", this);
 	virtualfs->mknod("/networkctl/disconnect", this);
+	virtualfs->mknod("/networkctl/hints", this);
+	virtualfs->mknod("/networkctl/latency", this);
 	virtualfs->mknod("/networkctl/list", this);
+	virtualfs->mknod("/networkctl/links", this);
+	virtualfs->mknod("/networkctl/remove", this);
+	virtualfs->mknod("/networkctl/routes", this);
 }
 
 void NetworkCtl::deinitVFS() throw()
@@ -93,9 +99,14 @@ void NetworkCtl::on(Help, const string& cwd, Client* c) throw()
 	assert(cwd == "/networkctl/");
 	c->doPrivateMessage(
 			"The following commands are available to you:\n"
-			"connect <host> <port> <password>\tconnect to hub\n"
+			"connect <host> <port> <password>\tconnect to hub, and keep reconnecting\n"
 			"disconnect <cid>\t\tdisconnect hub\n"
-			"list\t\t\t\tshows the list of directly connected hubs"
+			"hints\t\t\t\tsuggests links to add or drop, for fewer hops and less delay\n"
+			"latency\t\t\t\tshows the round trips of our links, and of the rest of the network\n"
+			"list\t\t\t\tshows the directly connected hubs, and what's waiting for them\n"
+			"links\t\t\t\tshows how the links we keep up are doing\n"
+			"remove <host> <port>\t\tstops keeping up a link, and closes it\n"
+			"routes\t\t\t\tshows the way to each hub on the network"
 	);
 }
 
@@ -113,7 +124,8 @@ void NetworkCtl::on(Exec, const string& cwd, Client* c, const StringList& arg) t
 				c->doPrivateMessage("Port parameter is not a number.");
 				return;
 			}
-			ConnectionManager::instance()->openInterConnection(arg[1], port, arg[3]);
+			if(!ConnectionManager::instance()->openInterConnection(arg[1], port, arg[3]))
+				c->doPrivateMessage("There's a link to " + arg[1] + ':' + arg[2] + " already.");
 		}
 	} else if(arg[0] == "disconnect") {
 	/*	if(arg.size() != 2) {
@@ -128,6 +140,22 @@ void NetworkCtl::on(Exec, const string& cwd, Client* c, const StringList& arg) t
 				}
 			}
 		}*/
+	} else if(arg[0] == "remove") {
+		if(arg.size() != 3) {
+			c->doPrivateMessage("Usage: remove <host> <port>");
+		} else {
+			int port;
+			try {
+				port = Util::toInt(arg[2]);
+			} catch(const boost::bad_lexical_cast&) {
+				c->doPrivateMessage("Port parameter is not a number.");
+				return;
+			}
+			if(ConnectionManager::instance()->closeInterConnection(arg[1], port))
+				c->doPrivateMessage("Link to " + arg[1] + ':' + arg[2] + " removed.");
+			else
+				c->doPrivateMessage("No link to " + arg[1] + ':' + arg[2] + '.');
+		}
 	} else if(arg[0] == "list") {
 		string ret = "Connected Hubs:";
 		for(Interhubs::iterator i = interhubs.begin(); i != interhubs.end(); ++i) {
@@ -135,7 +163,22 @@ void NetworkCtl::on(Exec, const string& cwd, Client* c, const StringList& arg) t
 			//ret += (*i)->getCID32();
 			ret += "   ";
 			ret += (*i)->getSocket()->getPeerName();
+			ret += ": " + Util::toString((*i)->getBacklog()) + " bytes waiting";
+			if((*i)->isCongested())
+				ret += ", congested";
+			if((*i)->getShed())
+				ret += ", " + Util::toString((*i)->getShed()) + " searches dropped";
 		}
 		c->doPrivateMessage(ret);
+	} else if(arg[0] == "links") {
+		const string& links = ConnectionManager::instance()->getLinkStatus();
+		c->doPrivateMessage(links.empty() ? string("No links configured.") : "Links:\n" + links);
+	} else if(arg[0] == "routes") {
+		const string& routes = ServerManager::instance()->getRouteStatus();
+		c->doPrivateMessage(routes.empty() ? string("No other hubs.") : "Routes:\n" + routes);
+	} else if(arg[0] == "latency") {
+		c->doPrivateMessage(ServerManager::instance()->getLatencyStatus());
+	} else if(arg[0] == "hints") {
+		c->doPrivateMessage(ServerManager::instance()->getTopologyHints());
 	}
 }
@@ -4,6 +4,8 @@
 #include "error.h"
 #include "Command.h"
 #include "ConnectionBase.h"
+#include "Frame.h"
+#include "Inflater.h"
 #include "Logs.h"
 
 #define BUF_SIZE 1024
@@ -13,25 +15,49 @@ using namespace qhub;
 
 ADCSocket::ADCSocket(int fd, Domain domain) throw()
 		: Socket(fd, domain),
-		readBuffer(new char[BUF_SIZE]), readPos(0), conn(NULL)
+		readBuffer(new char[BUF_SIZE]), readPos(0), inflater(NULL), framed(false), dataLeft(0),
+		conn(NULL)
 {
 	EventManager::instance()->enableRead(getFd(), this);
 	setNoLinger();
+	// accept() doesn't pass O_NONBLOCK on; without it one slow reader
+	// blocks the whole event loop in write()
+	setNonBlocking();
 }
 
 ADCSocket::ADCSocket() throw()
 		: Socket(), readBuffer(new char[BUF_SIZE]),
-		readPos(0), conn(NULL) {}
+		readPos(0), inflater(NULL), framed(false), dataLeft(0), conn(NULL) {}
 
 ADCSocket::~ADCSocket() throw()
 {
 	EventManager::instance()->removeTimer(this);
 	delete[] readBuffer;
+	delete inflater;
 }
 
 //this is an ugly way to "factor out" the check for disconnectedness
 void ADCSocket::handleOnRead()
 {
+	if(inflater || framed) {
+		char raw[BUF_SIZE];
+		int ret = read(raw, BUF_SIZE);
+		feed(raw, ret);
+		return;
+	}
+
+	if(dataLeft && readPos == 0) {
+		// binary data goes straight where it's wanted
+		size_t old = data.size();
+		data.resize(old + min<size_t>(dataLeft, 64 * 1024));
+		int ret = read(&data[old], data.size() - old);
+		data.resize(old + ret);
+		dataLeft -= ret;
+		if(!dataLeft)
+			takeData(readBuffer, readBuffer);
+		return;
+	}
+
 	int ret = read(readBuffer+readPos, BUF_SIZE-readPos);
 
 	char* l = readBuffer;
@@ -49,9 +75,20 @@ void ADCSocket::handleOnRead()
 		Command cmd(l, tmp);
 		l = tmp+1;
 
+		if(startInflate(cmd) || startFraming(cmd)) {
+			// the rest is compressed or framed; take it out of the line buffer
+			vector<char> rest(l, r);
+			readPos = 0;
+			if(!rest.empty())
+				feed(&rest[0], rest.size());
+			return;
+		}
 		conn->onLine(cmd);
 		if(disconnected)
 			return;
+		l = takeData(l, r);
+		if(disconnected)
+			return;
 	}
 	readPos = r - l;
 	if(readPos == BUF_SIZE)
@@ -60,6 +97,141 @@ void ADCSocket::handleOnRead()
 	::memmove(readBuffer, l, readPos);
 }
 
+char* ADCSocket::takeData(char* l, char* r) throw(command_error)
+{
+	if(!dataLeft && data.empty())
+		return l;
+	size_t n = min<size_t>(dataLeft, r - l);
+	data.insert(data.end(), l, l + n);
+	dataLeft -= n;
+	if(!dataLeft) {
+		vector<uint8_t> tmp;
+		tmp.swap(data);
+		conn->onData(tmp);
+	}
+	return l + n;
+}
+
+bool ADCSocket::startInflate(const Command& cmd) throw(parse_error)
+{
+	// we only say we take ZLIF on interhub links
+	if(cmd != ('I' | Command::ZON) || !conn->hasSupport("IHUB"))
+		return false;
+	try {
+		inflater = new Inflater(conn->getZDictionary());
+	} catch(const runtime_error& e) {
+		throw parse_error(e.what());
+	}
+	return true;
+}
+
+bool ADCSocket::startFraming(const Command& cmd) throw()
+{
+	// likewise only on interhub links
+	if(cmd != ('L' | Command::FRM) || !conn->hasSupport("IHUB"))
+		return false;
+	framed = true;
+	return true;
+}
+
+void ADCSocket::feed(const char* p, size_t n) throw(command_error, parse_error)
+{
+	// slow path, used around compressed or framed input: everything is
+	// copied into the line buffer, a line (or frame) at a time
+	while(n && !disconnected) {
+		const char* in = p;
+		size_t len = n;
+		bool plain = !inflater;
+		if(!plain) {
+			zbuf.clear();
+			size_t used;
+			try {
+				used = inflater->read(p, n, zbuf);
+			} catch(const runtime_error& e) {
+				throw parse_error(e.what());
+			}
+			p += used;
+			n -= used;
+			if(inflater->finished()) {
+				delete inflater;
+				inflater = NULL;
+			}
+			if(zbuf.empty())
+				continue;
+			in = reinterpret_cast<const char*>(&zbuf[0]);
+			len = zbuf.size();
+		} else {
+			p += n;
+			n = 0;
+		}
+
+		const char* end = in + len;
+		while(in != end) {
+			if(framed) {
+				in = takeFrames(in, end);
+				if(disconnected)
+					return;
+				continue;
+			}
+			const char* nl = find(in, end, '\n');
+			if(readPos + (nl - in) >= BUF_SIZE)
+				throw parse_error("line limit of 1024 characters exceeded");
+			::memcpy(readBuffer + readPos, in, nl - in);
+			readPos += nl - in;
+			if(nl == end)
+				break;
+			in = nl + 1;
+			if(readPos == 0)
+				continue;	// ignore keepalives
+#ifdef DEBUG
+			Logs::line << getFd() << "<< " << string(readBuffer, readPos) << endl;
+#endif
+			Command cmd(readBuffer, readBuffer + readPos);
+			readPos = 0;
+			if(cmd == ('I' | Command::ZOF) || (!plain && cmd == ('I' | Command::ZON))
+					|| startFraming(cmd))
+				continue;
+			if(plain && startInflate(cmd)) {
+				// what's left of this chunk is compressed too
+				p = in;
+				n = end - in;
+				break;
+			}
+			conn->onLine(cmd);
+			if(disconnected)
+				return;
+		}
+	}
+}
+
+const char* ADCSocket::takeFrames(const char* in, const char* end) throw(command_error, parse_error)
+{
+	// what fits goes after what we have of the last frame; a whole frame
+	// always fits
+	size_t n = min<size_t>(end - in, BUF_SIZE - readPos);
+	::memcpy(readBuffer + readPos, in, n);
+	readPos += n;
+
+	const char* l = readBuffer;
+	const char* r = readBuffer + readPos;
+	string line;
+	size_t len;
+	while((len = Frame::size(l, r)) != 0) {
+		Frame::toLine(l, l + len, line);
+		l += len;
+#ifdef DEBUG
+		Logs::line << getFd() << "<< " << line << endl;
+#endif
+		Command cmd(line.data(), line.data() + line.size());
+		conn->onLine(cmd);
+		if(disconnected)
+			return end;
+	}
+	readPos = r - l;
+	::memmove(readBuffer, l, readPos);
+	return in + n;
+}
+
 void ADCSocket::onTimer(int) throw()
 {
 	if(!disconnected) {
@@ -80,12 +252,10 @@ void ADCSocket::onRead(int) throw()
 		disconnect(e.what());
 	} catch(const parse_error& e) {
 		// stuff that's not even valid ADC -> silent disconnect
-		while(!queue.empty())
-			queue.pop();
+		clearQueue();
 		disconnect(e.what());
 	} catch(const socket_error& e) {
-		while(!queue.empty())
-			queue.pop();
+		clearQueue();
 		disconnect(e.what());
 	}
 	// do this as the last thing before we return, see notes in realDisconnect
@@ -97,7 +267,11 @@ void ADCSocket::onRead(int) throw()
 void ADCSocket::onWrite(int) throw()
 {
 	partialWrite();
-	if(queue.empty()) {
+	if(blocked()) {
+		// nothing to do until what's next has been made
+		EventManager::instance()->disableWrite(getFd());
+		writeEnabled = false;
+	} else if(queue.empty() && !source) {
 		// possibly move this part to before partialWrite,
 		// as a read on another socket will most likely
 		// cause us to need to write again
@@ -5,8 +5,10 @@
 #include "qhub.h"
 #include "Socket.h"
 #include "Util.h"
+#include "error.h"
 
 #include <string>
+#include <vector>
 
 namespace qhub {
 
@@ -31,6 +33,10 @@ public:
 
 	virtual void disconnect(std::string const& msg = Util::emptyString);
 
+	// the next n bytes after the current line are binary; they're handed
+	// to the connection's onData in one piece
+	void expectData(size_t n) throw() { dataLeft = n; }
+
 protected:
 	/*
 	 * Do protocol stuff / Handle events
@@ -39,10 +45,27 @@ protected:
 
 private:
 	void handleOnRead();
+	bool startInflate(const Command& cmd) throw(parse_error);
+	bool startFraming(const Command& cmd) throw();
+	void feed(const char* p, size_t n) throw(command_error, parse_error);
+	// takes what frames it can out of [in, end); returns how far it got
+	const char* takeFrames(const char* in, const char* end) throw(command_error, parse_error);
+	// takes what's expected of [l, r) out as binary data; returns the rest
+	char* takeData(char* l, char* r) throw(command_error);
 
 	char* readBuffer;
 	size_t readPos;
 
+	// set while the other end is sending us a ZLIF stream
+	Inflater* inflater;
+	std::vector<uint8_t> zbuf;
+	// set once the other end has switched to frames (see Frame)
+	bool framed;
+
+	// expectData()
+	size_t dataLeft;
+	std::vector<uint8_t> data;
+
 	ConnectionBase* conn;
 };
 
@@ -0,0 +1,79 @@
+// vim:ts=4:sw=4:noet
+#include "BloomManager.h"
+
+#include "ClientManager.h"
+#include "HashBloom.h"
+#include "InterHub.h"
+#include "ServerManager.h"
+#include "Settings.h"
+#include "XmlTok.h"
+
+using namespace std;
+using namespace qhub;
+
+BloomManager::BloomManager() throw() : scheduled(false)
+{
+	XmlTok* p = Settings::instance()->getConfig("__hub");
+	hubBits = Settings::getInt(p, "blomhubbits", 1 << 21);
+	interval = Settings::getInt(p, "blominterval", 60);
+	// has to be a power of two (of at least a byte) to fold into
+	size_t m = 8;
+	while(m < hubBits && m < (size_t(1) << HashBloom::H))
+		m <<= 1;
+	hubBits = m;
+	userBits = Settings::getInt(p, "blomuserbits", 1 << 20);
+	m = 8;
+	while(m < userBits && m < (size_t(1) << HashBloom::H))
+		m <<= 1;
+	userBits = m;
+}
+
+void BloomManager::changed() throw()
+{
+	if(scheduled)
+		return;
+	scheduled = true;
+	EventManager::instance()->addTimer(this, 0, interval);
+}
+
+void BloomManager::dropped(const InterHub* from) throw()
+{
+	typedef ServerManager::Interhubs::const_iterator CI;
+	const ServerManager::Interhubs& links = ServerManager::instance()->getInterhubs();
+	for(CI i = links.begin(); i != links.end(); ++i) {
+		if(*i != from && (*i)->hasSupport("BLOM"))
+			(*i)->sendBloom(HashBloom());
+	}
+	// the real one, once it's there
+	changed();
+}
+
+void BloomManager::onTimer(int) throw()
+{
+	scheduled = false;
+
+	HashBloom local;
+	local.reset(hubBits);
+	bool whole = ClientManager::instance()->foldBlooms(local);
+
+	typedef ServerManager::Interhubs::const_iterator CI;
+	const ServerManager::Interhubs& links = ServerManager::instance()->getInterhubs();
+	for(CI i = links.begin(); i != links.end(); ++i) {
+		if(!(*i)->hasSupport("BLOM"))
+			continue;
+		HashBloom agg;
+		if(whole) {
+			agg = local;
+			for(CI j = links.begin(); j != links.end(); ++j) {
+				if(j == i)
+					continue;
+				if((*j)->getBloom().empty()) {
+					agg.clear();
+					break;
+				}
+				(*j)->getBloom().foldInto(agg);
+			}
+		}
+		(*i)->sendBloom(agg);
+	}
+}
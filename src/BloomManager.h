@@ -0,0 +1,48 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_BLOOMMANAGER_H
+#define QHUB_BLOOMMANAGER_H
+
+#include "qhub.h"
+#include "EventManager.h"
+#include "Singleton.h"
+
+namespace qhub {
+
+/*
+ * Tells linked hubs which TTHs may be found through us, so they only pass
+ * on TTH searches there's a point in.  Each BLOM-capable link gets one
+ * filter of blomhubbits (<__hub>) bits, folded from the filters of our own
+ * users and those the other links sent us; if any of them has none, it
+ * gets "no filter" and is sent everything.  Filters go out at most every
+ * blominterval seconds, and only to the links theirs changed for, except
+ * for "no filter", which can't wait.  Users are asked for filters of at
+ * most blomuserbits bits, as they're kept for as long as they stay.
+ */
+class BloomManager : public Singleton<BloomManager>, public EventListener {
+public:
+	// the most a user's filter may have; a power of two
+	size_t getUserBits() const throw() { return userBits; }
+
+	// a filter that goes into what we send changed
+	void changed() throw();
+	// one is gone, so a user or link may have files the filters the links
+	// hold don't: they hear "no filter" now rather than wait for the
+	// interval; from, if it's a link's, isn't told
+	void dropped(const InterHub* from = NULL) throw();
+
+	virtual void onTimer(int) throw();
+
+private:
+	friend class Singleton<BloomManager>;
+
+	size_t hubBits, userBits;
+	int interval;	// seconds
+	bool scheduled;
+
+	BloomManager() throw();
+	~BloomManager() throw() {}
+};
+
+} // namespace qhub
+
+#endif // QHUB_BLOOMMANAGER_H
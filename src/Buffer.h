@@ -30,6 +30,21 @@ public:
 		buf.insert(buf.end(), cmd.toString().begin(), cmd.toString().end());
 	}
 
+	void append(const Buffer& b)
+	{
+		buf.insert(buf.end(), b.data(), b.data() + b.size());
+	}
+
+	void reserve(std::vector<uint8_t>::size_type n) { buf.reserve(n); }
+
+	// take over the contents of v (and hand back ours)
+	void swap(std::vector<uint8_t>& v) { buf.swap(v); }
+
+	// false while the contents are still being made (see DeferredBuffer)
+	virtual bool ready() const { return true; }
+	// true if they're made later, so the size isn't known when queued
+	virtual bool deferred() const { return false; }
+
 	virtual const uint8_t* data() const { return &buf[0]; }
 	virtual std::vector<uint8_t>::size_type size() const { return buf.size(); }
 
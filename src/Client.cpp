@@ -2,13 +2,14 @@
 #include "Client.h"
 
 #include "ADC.h"
+#include "BloomManager.h"
 #include "ClientManager.h"
 #include "Encoder.h"
 #include "Hub.h"
 #include "Logs.h"
 #include "Plugin.h"
 #include "PluginManager.h"
-#include "ServerManager.h"
+#include "SearchCache.h"
 #include "TigerHash.h"
 #include "UserData.h"
 #include "UserInfo.h"
@@ -18,13 +19,16 @@ using namespace std;
 using namespace qhub;
 
 Client::Client(ADCSocket* s) throw()
-		: ConnectionBase(s), added(false), userData(NULL), userInfo(NULL)
+		: ConnectionBase(s), added(false), bloomsAsked(0), bloomBytes(0), userData(NULL),
+		userInfo(NULL), sid(INVALID_SID)
 {
 	onConnected();
 }
 
 Client::~Client() throw()
 {
+	if(sid != INVALID_SID)
+		ClientManager::instance()->releaseSid(sid);
 	if(userInfo)
 		delete userInfo;
 	if(userData)
@@ -58,14 +62,34 @@ void Client::login() throw()
 				<< "VE" PACKAGE_NAME "/" PACKAGE_VERSION
 				<< "HO1" << "OP1"
 				<< "IDTHISISTHECIDOFTHEQHUBBOTAAAAAAAAAAAAAAA");
-	// Send INFs
+	// Send INFs; they're streamed, and anything else sent to him is held
+	// back until the list is through
 	ClientManager::instance()->getUserList(this);
+	ClientManager::instance()->startZStream(this);
 
 	added = true;
 	ClientManager::instance()->addLocalClient(getSid(), this);
 	// Notify him that userlist is over and notify others of his presence
 	dispatch(getAdcInf());
 	Hub::instance()->motd(this);
+	requestBloom();
+}
+
+void Client::requestBloom() throw()
+{
+	if(!hasSupport("BLOM"))
+		return;
+	size_t files = 0;
+	try {
+		if(userInfo->has("SF"))
+			files = Util::toInt(userInfo->get("SF"));
+	} catch(const boost::bad_lexical_cast&) {}
+	size_t n = HashBloom::bitsFor(files, BloomManager::instance()->getUserBits()) / 8;
+	bloomBytes = bloomsAsked++ ? max(bloomBytes, n) : n;
+	send(Command('I', Command::GET) << "blom" << "/" << "0"
+			<< Util::toString(n)
+			<< CmdParam("BK", Util::toString(HashBloom::K))
+			<< CmdParam("BH", Util::toString(HashBloom::H)));
 }
 
 void Client::logout() throw()
@@ -253,6 +277,9 @@ void Client::handle(Command& cmd) throw(command_error) {
 		if(cmd.getCmd() == Command::DSC) {
 			handleDisconnect(cmd);
 			return;
+		} else if(cmd.getCmd() == Command::SND) {
+			handleBloom(cmd);
+			return;
 		} else {
 			doWarning("Unknown hub-directed message ignored");
 			return;
@@ -270,6 +297,10 @@ void Client::handle(Command& cmd) throw(command_error) {
 	} else if(cmd.getCmd() == Command::MSG) {
 		handleMessage(cmd);
 		return;
+	// * ?SCH *
+	} else if(cmd.getCmd() == Command::SCH) {
+		handleSearch(cmd);
+		return;
 	// * Everything else *
 	} else {
 		dispatch(cmd);
@@ -354,7 +385,7 @@ void Client::handleInfo(Command& cmd) throw(command_error)
 
 	// check nick; we know the current one is valid
 	if(newUserInfo.has("NI")) {
-		if(ClientManager::instance()->hasNick(newUserInfo.getNick())) {
+		if(ClientManager::instance()->hasNick(newUserInfo.getNick(), getSid())) {
 			doWarning("That nick is already taken");
 			newUserInfo.del("NI");
 		} else {
@@ -367,6 +398,13 @@ void Client::handleInfo(Command& cmd) throw(command_error)
 
 	// Merge new data
 	userInfo->update(newUserInfo);
+	if(newUserInfo.has("SF") && hasSupport("BLOM")) {
+		// the old filter may be missing new files
+		bloom.clear();
+		requestBloom();
+		BloomManager::instance()->dropped();
+	}
+	ClientManager::instance()->refresh(this);
 }
 
 void Client::handleAddr(UserInfo& ui) throw(command_error)
@@ -392,6 +430,38 @@ void Client::handleAddr(UserInfo& ui) throw(command_error)
 #endif
 }
 
+void Client::handleSearch(Command& cmd) throw()
+{
+	if(SearchCache::instance()->repeated(cmd))
+		return;
+	dispatch(cmd);
+}
+
+void Client::handleBloom(Command& cmd) throw(command_error)
+{
+	// HSND blom / 0 <bytes>, then the filter itself
+	if(cmd[0] != "blom" || !bloomsAsked)
+		throw command_error("unexpected SND");
+	// not necessarily the size we asked for last, if the share changed
+	// since, but any power of two up to what we asked for will do; it's
+	// kept for as long as they stay
+	size_t n = 0;
+	try {
+		n = Util::toInt(cmd[3]);
+	} catch(const boost::bad_lexical_cast&) {}
+	if(n < 8 || n > bloomBytes || (n & (n - 1)))
+		throw command_error("bad bloom filter size");
+	getSocket()->expectData(n);
+}
+
+void Client::onData(vector<uint8_t>& data) throw(command_error)
+{
+	--bloomsAsked;
+	bloom.swap(data);
+	ClientManager::instance()->refresh(this);
+	BloomManager::instance()->changed();
+}
+
 void Client::handleMessage(Command& cmd) throw()
 {
 	if(cmd.getAction() == 'D' && cmd.getDest() == Hub::instance()->getBotSid()) {
@@ -460,10 +530,9 @@ void Client::handleSupports(Command& cmd) throw(command_error)
 	if(!hasSupport("BASE") || !hasSupport("TIGR"))
 		throw command_error("Invalid supports");
 	send(Command('I', Command::SUP) << CmdParam("AD", "BASE") << CmdParam("AD", "TIGR"));
-	// use file descriptor for ID... just make sure we haven't overflowed
-	if((unsigned)getSocket()->getFd() != (ServerManager::instance()->getClientSidMask() & getSocket()->getFd()))
+	this->sid = ClientManager::instance()->allocSid();
+	if(this->sid == INVALID_SID)
 		throw command_error("hub is full", 11);
-	this->sid = (Hub::instance()->getSid() & ServerManager::instance()->getHubSidMask()) | getSocket()->getFd();
 	send(Command('I', Command::SID) << ADC::fromSid(this->sid));
 	send(Hub::instance()->getAdcInf());
 	state = IDENTIFY;
@@ -4,6 +4,7 @@
 
 #include "qhub.h"
 #include "ConnectionBase.h"
+#include "HashBloom.h"
 #include "Util.h"
 
 #include <string>
@@ -30,6 +31,8 @@ public:
 	UserData* getUserData() throw();
 	UserInfo* getUserInfo() throw() { return userInfo; };
 	sid_type getSid() const throw() { return sid; };
+	// empty until (unless) the client sent us one
+	const HashBloom& getBloom() const throw() { return bloom; }
 
 	/*
 	 * Various calls (don't send in bad states!)
@@ -50,6 +53,7 @@ public:
 	 * Calls from ADCSocket
 	 */
 	virtual void onLine(Command& cmd) throw(command_error);
+	virtual void onData(std::vector<uint8_t>& data) throw(command_error);
 	virtual void onConnected() throw();
 	virtual void onDisconnected(std::string const& clue) throw();
 
@@ -64,12 +68,21 @@ private:
 	void handleDisconnect(Command&) throw();
 	void handleInfo(Command&) throw(command_error);
 	void handleMessage(Command&) throw();
+	void handleSearch(Command&) throw();
+	void handleBloom(Command&) throw(command_error);
 	void handleAddr(UserInfo&) throw(command_error);
 
 	void login() throw();
 	void logout() throw();
 	bool added;
 
+	// asks for a filter sized for the current share, if the client can
+	void requestBloom() throw();
+	HashBloom bloom;
+	// requests not answered yet, and the biggest (in bytes) of them
+	int bloomsAsked;
+	size_t bloomBytes;
+
 	UserData* userData;
 	UserInfo* userInfo;
 
@@ -2,42 +2,124 @@
 #include "ClientManager.h"
 
 #include "ADC.h"
+#include "BloomManager.h"
 #include "Client.h"
+#include "CompressJob.h"
+#include "CompressionManager.h"
 #include "ConnectionBase.h"
+#include "DeferredBuffer.h"
+#include "Deflater.h"
+#include "FanOutJob.h"
+#include "HashBloom.h"
+#include "Hub.h"
 #include "Logs.h"
 #include "ServerManager.h"
+#include "Settings.h"
+#include "TigerHash.h"
 #include "UserInfo.h"
+#include "UserListStream.h"
 #include "Util.h"
+#include "WorkerPool.h"
+#include "XmlTok.h"
+#include "ZBroadcast.h"
 #include "ZBuffer.h"
+#include "ZStream.h"
+
+#include <sys/time.h>
 
 using namespace std;
 using namespace qhub;
 
-void ClientManager::getUserList(ConnectionBase* c) throw()
+ClientManager::ClientManager() throw()
+		: localUsers(ServerManager::instance()->getClientSidMask()),
+		queuedBytes(0), zshared(NULL), zbatch(NULL)
 {
-	// if we can, compress the user list
-	// TODO cache this, and rebuild every once in a while
-	// like Aquila does
-	if(c->hasSupport("ZLIF")) {
-		ZBuffer::MutablePtr t(new ZBuffer);
-		fillUserListBuf(t);
-		t->finalize();
-		c->getSocket()->writeb(t);
-	} else {
-		Buffer::MutablePtr t(new Buffer);
-		fillUserListBuf(t);
-		c->getSocket()->writeb(t);
+	XmlTok* p = Settings::instance()->getConfig("__hub");
+
+	// milliseconds; 0 means at once
+	delays[DELAY_CHAT] = Settings::getInt(p, "chatdelay", 0);
+	delays[DELAY_INF] = Settings::getInt(p, "infdelay", 500);
+	delays[DELAY_SCH] = Settings::getInt(p, "schdelay", 200);
+	batchSize = Settings::getInt(p, "batchsize", 32 * 1024);
+	// users a broadcast must have for its writes to be split over the
+	// WorkerPool; 0 is never
+	fanOut = Settings::getInt(p, "fanout", 0);
+	timerclear(&deadline);
+
+	if(p->getAttr("zlibstream") == "1") {
+		// plain bytes of broadcasts between keyframes; less means clients
+		// that got a private message fall back in step sooner, more means
+		// better compression
+		const string& k = p->getAttr("zlibkeyframe");
+		try {
+			zshared = new ZBroadcast(CompressionManager::instance()->getLevel(), k.empty() ? 64 * 1024 : Util::toInt(k));
+			Logs::stat << "Persistent ZLIF streams enabled" << endl;
+		} catch(const exception& e) {
+			Logs::err << "Persistent ZLIF streams disabled: " << e.what() << endl;
+		}
 	}
 }
 
-void ClientManager::fillUserListBuf(Buffer::MutablePtr t)
+ClientManager::~ClientManager() throw()
+{
+	delete zshared;
+	delete zbatch;
+}
+
+void ClientManager::startZStream(ConnectionBase* c) throw()
 {
-	for(LocalUsers::iterator i = localUsers.begin(); i != localUsers.end(); i++) {
-		t->append(i->second->getAdcInf());
+	if(!zshared || !c->hasSupport("ZLIF"))
+		return;
+	try {
+		c->getSocket()->setZStream(new ZStream(CompressionManager::instance()->getLevel()));
+	} catch(const runtime_error& e) {
+		Logs::err << "no persistent ZLIF stream: " << e.what() << endl;
 	}
-	for(RemoteUsers::iterator i = remoteUsers.begin(); i != remoteUsers.end(); i++) {
-		t->append(i->second->toADC(i->first));
+}
+
+void ClientManager::getUserList(ConnectionBase* c, bool remoteOnly) throw()
+{
+	// only the SIDs are copied now; the INFs themselves are serialized (and
+	// compressed, if we can) bit by bit as the connection can take them
+	vector<sid_type> sids;
+	sids.reserve(localUsers.size() + remoteUsers.size());
+	if(!remoteOnly)
+		for(LocalUsers::const_iterator i = localUsers.begin(); i != localUsers.end(); i++)
+			sids.push_back((*i)->getSid());
+	for(RemoteUsers::iterator i = remoteUsers.begin(); i != remoteUsers.end(); i++)
+		sids.push_back(i->first);
+	// c hears of everybody in the list, queued INF or not, so they must
+	// get a QUI when they go
+	if(!remoteOnly) {
+		joining.clear();
+	} else {
+		for(QHUB_FAST_SET<sid_type>::iterator i = joining.begin(); i != joining.end(); ) {
+			if(remoteUsers.count(*i))
+				joining.erase(i++);
+			else
+				++i;
+		}
 	}
+	c->getSocket()->setSource(new UserListStream(sids, c->hasSupport("ZLIF"),
+			c->getZDictionary()));
+}
+
+UserInfo* ClientManager::getUserInfo(sid_type sid) throw()
+{
+	if(Client* c = localUsers.find(sid))
+		return c->getUserInfo();
+	RemoteUsers::iterator j = remoteUsers.find(sid);
+	if(j != remoteUsers.end())
+		return j->second;
+	return NULL;
+}
+
+sid_type ClientManager::allocSid() throw()
+{
+	sid_type s = localUsers.alloc();
+	if(s == INVALID_SID)
+		return s;
+	return (Hub::instance()->getSid() & ServerManager::instance()->getHubSidMask()) | s;
 }
 
 bool ClientManager::hasClient(sid_type sid, bool localonly) const throw()
@@ -47,39 +129,51 @@ bool ClientManager::hasClient(sid_type sid, bool localonly) const throw()
 
 void ClientManager::addLocalClient(sid_type sid, Client* client) throw()
 {
-	assert(!hasClient(sid));
-	localUsers.insert(make_pair(sid, client));
-	nicks.insert(client->getUserInfo()->getNick());
+	assert(!hasClient(sid) && sid == client->getSid());
+	localUsers.insert(client);
+	// it has no filter yet
+	BloomManager::instance()->dropped();
+	joining.insert(sid);
+	nicks.insert(client->getUserInfo()->getNick(), sid);
 	cids.insert(client->getUserInfo()->getCID());
 }
 
 void ClientManager::userUpdated(sid_type sid, UserInfo const& ui) throw()
 {
-	LocalUsers::iterator i = localUsers.find(sid);
-	if(i == localUsers.end())
+	Client* c = localUsers.find(sid);
+	if(!c)
 		assert(0); // maybe use this for remote later, but now...
 
-	const string& oldNick = i->second->getUserInfo()->getNick();
+	const string& oldNick = c->getUserInfo()->getNick();
 	const string& newNick = ui.getNick();
 	if(ui.has("NI")) {
-		nicks.erase(oldNick);
-		nicks.insert(newNick);
+		nicks.erase(oldNick, sid);
+		nicks.insert(newNick, sid);
 	}
 	// CID can't change, nothing else to do
 }
 
+void ClientManager::refresh(Client* c) throw()
+{
+	localUsers.update(c);
+}
+
 void ClientManager::addRemoteClient(sid_type sid, UserInfo const& ui) throw()
 {
 	assert(!hasClient(sid) || remoteUsers.count(sid));
-	if(!remoteUsers.count(sid))
+	if(!remoteUsers.count(sid)) {
 		remoteUsers[sid] = new UserInfo(Command('B', Command::INF, sid));
+		hubUsers[sid & ServerManager::instance()->getHubSidMask()].insert(sid);
+		joining.insert(sid);
+	}
 	if(ui.has("ID") && remoteUsers[sid]->has("ID")) {
 		cids.erase(remoteUsers[sid]->getCID());
 		cids.insert(ui.getCID());
 	}
-	if(ui.has("NI") && remoteUsers[sid]->has("NI")) {
-		nicks.erase(remoteUsers[sid]->getNick());
-		nicks.insert(ui.getNick());
+	if(ui.has("NI")) {
+		if(remoteUsers[sid]->has("NI"))
+			nicks.erase(remoteUsers[sid]->getNick(), sid);
+		nicks.insert(ui.getNick(), sid);
 	}
 	remoteUsers[sid]->update(ui);
 }
@@ -87,41 +181,164 @@ void ClientManager::addRemoteClient(sid_type sid, UserInfo const& ui) throw()
 void ClientManager::removeClient(sid_type sid) throw()
 {
 	assert(hasClient(sid));
-	if(localUsers.count(sid)) {
-		UserInfo* i = localUsers[sid]->getUserInfo();
-		nicks.erase(i->getNick());
+	if(Client* c = localUsers.find(sid)) {
+		UserInfo* i = c->getUserInfo();
+		nicks.erase(i->getNick(), sid);
 		cids.erase(i->getCID());
 		localUsers.erase(sid);
+		BloomManager::instance()->changed();
 	} else {
 		UserInfo* i = remoteUsers[sid];
-		nicks.erase(i->getNick());
+		nicks.erase(i->getNick(), sid);
 		cids.erase(i->getCID());
 		delete i;
 		remoteUsers.erase(sid);
+		HubIndex::iterator h = hubUsers.find(sid & ServerManager::instance()->getHubSidMask());
+		h->second.erase(sid);
+		if(h->second.empty())
+			hubUsers.erase(h);
+	}
+}
+
+void ClientManager::netsplit(sid_type hsid) throw()
+{
+	HubIndex::iterator h = hubUsers.find(hsid & ServerManager::instance()->getHubSidMask());
+	if(h == hubUsers.end())
+		return;
+
+	Buffer::MutablePtr quits(new Buffer);
+	quits->reserve(h->second.size() * 10);
+	for(HubUsers::const_iterator i = h->second.begin(); i != h->second.end(); ++i) {
+		RemoteUsers::iterator j = remoteUsers.find(*i);
+		nicks.erase(j->second->getNick(), *i);
+		cids.erase(j->second->getCID());
+		delete j->second;
+		remoteUsers.erase(j);
+
+		QHUB_FAST_MAP<sid_type, BroadcastQueue::iterator>::iterator q = queuedInfs.find(*i);
+		if(q != queuedInfs.end()) {
+			queuedBytes -= q->second->cmd.toString().size();
+			broadcastQueue.erase(q->second);
+			queuedInfs.erase(q);
+		}
+		if(!joining.erase(*i))
+			quits->append(Command('I', Command::QUI) << ADC::fromSid(*i));
 	}
+	hubUsers.erase(h);
+
+	// whatever else they said has to get there before they're gone
+	if(!broadcastQueue.empty())
+		purgeQueue();
+	sendBatch(quits);
 }
 
 void ClientManager::getAllInHub(sid_type hsid, std::vector<sid_type>& ret) const throw()
 {
 	// should not be looking for local users
 	ret.clear();
-	sid_type mask = ServerManager::instance()->getHubSidMask();
-	for(RemoteUsers::const_iterator i = remoteUsers.begin(); i != remoteUsers.end(); ++i)
-		if((i->first & mask) == (hsid & mask))
-			ret.push_back(i->first);
+	HubIndex::const_iterator h = hubUsers.find(hsid & ServerManager::instance()->getHubSidMask());
+	if(h != hubUsers.end())
+		ret.assign(h->second.begin(), h->second.end());
+}
+
+bool ClientManager::foldBlooms(HashBloom& agg) const throw()
+{
+	for(LocalUsers::size_type i = 0; i < localUsers.size(); ++i) {
+		const HashBloom* b = localUsers.getBloom(i);
+		if(!b)
+			return false;
+		b->foldInto(agg);
+	}
+	return true;
+}
+
+ClientManager::Delay ClientManager::delayOf(const Command& cmd) throw()
+{
+	switch(cmd.getCmd()) {
+	case Command::INF:
+		return DELAY_INF;
+	case Command::SCH:
+		return DELAY_SCH;
+	default:
+		return DELAY_CHAT;
+	}
 }
 
 void ClientManager::broadcast(const Command& cmd) throw()
 {
-	// should be safe to delay these
-	if(cmd.getCmd() == Command::SCH || cmd.getCmd() == Command::INF) {
-		if(broadcastQueue.empty())
-			EventManager::instance()->addTimer(this, 0, 5); // FIXME allow timeout to be settable
-		broadcastQueue.push_back(cmd);
-	} else {
-		broadcastQueue.push_back(cmd);
-		EventManager::instance()->removeTimer(this);
+	// QUI is about its parameter, not the (hub) sending it
+	sid_type from = cmd.getSource();
+	if(cmd.getCmd() == Command::QUI) {
+		try {
+			from = ADC::toSid(cmd[0]);
+		} catch(const parse_error&) {}
+	}
+	int d = delays[delayOf(cmd)];
+
+	if(cmd.getCmd() == Command::INF) {
+		QHUB_FAST_MAP<sid_type, BroadcastQueue::iterator>::iterator i = queuedInfs.find(from);
+		if(i != queuedInfs.end() && i->second->cmd.getAction() == cmd.getAction()) {
+			// nobody's seen the queued one yet, so one INF with both will do
+			queuedBytes -= i->second->cmd.toString().size();
+			i->second->cmd.merge(cmd);
+			queuedBytes += i->second->cmd.toString().size();
+			return;
+		}
+	} else if(cmd.getCmd() == Command::QUI) {
+		QHUB_FAST_MAP<sid_type, BroadcastQueue::iterator>::iterator i = queuedInfs.find(from);
+		if(i != queuedInfs.end()) {
+			// no point telling anyone about someone who's gone
+			queuedBytes -= i->second->cmd.toString().size();
+			broadcastQueue.erase(i->second);
+			queuedInfs.erase(i);
+		}
+		if(joining.erase(from))
+			return;	// nobody's heard of them
+	}
+
+	// a passive user can't connect to other passive ones, so there's no
+	// point in them getting its searches
+	bool passive = cmd.getCmd() == Command::SCH && !isActive(from);
+
+	// users' bloom filters tell who to send a TTH search to, and that's
+	// best done for each by itself, so it doesn't wait for company
+	uint8_t tth[TigerHash::HASH_SIZE];
+	if(HashBloom::searchedTth(cmd, tth)) {
+		if(queuedFrom.count(from))
+			purgeQueue();
+		sendBatch(Buffer::Ptr(new Buffer(cmd)), passive ? LocalUsers::ACTIVE : 0, tth);
+		return;
+	}
+
+	if(d <= 0 && !queuedFrom.count(from)) {
+		// nothing of the same user's in the queue it would overtake
+		if(cmd.getCmd() == Command::INF)
+			joining.erase(from);
+		sendBatch(Buffer::Ptr(new Buffer(cmd)), passive ? LocalUsers::ACTIVE : 0);
+		return;
+	}
+
+	broadcastQueue.push_back(Queued(cmd, passive ? LocalUsers::ACTIVE : 0));
+	if(cmd.getCmd() == Command::INF)
+		queuedInfs[from] = --broadcastQueue.end();
+	queuedFrom.insert(from);
+	queuedBytes += cmd.toString().size();
+	if(d <= 0 || queuedBytes >= batchSize) {
 		purgeQueue();
+		return;
+	}
+
+	timeval now, due;
+	gettimeofday(&now, NULL);
+	due.tv_sec = now.tv_sec + d / 1000;
+	due.tv_usec = now.tv_usec + (d % 1000) * 1000;
+	if(due.tv_usec >= 1000000) {
+		due.tv_sec++;
+		due.tv_usec -= 1000000;
+	}
+	if(!timerisset(&deadline) || timercmp(&due, &deadline, <)) {
+		deadline = due;
+		EventManager::instance()->addTimer(this, 0, d / 1000, (d % 1000) * 1000);
 	}
 }
 
@@ -132,48 +349,189 @@ void ClientManager::onTimer(int) throw()
 
 void ClientManager::purgeQueue() throw()
 {
-	typedef vector<Command>::const_iterator QI;
+	EventManager::instance()->removeTimer(this);
+	timerclear(&deadline);
+
+	BroadcastQueue q;
+	q.swap(broadcastQueue);
+	queuedInfs.clear();
+	joining.clear();
+	queuedFrom.clear();
+	queuedBytes = 0;
+
+	// in order, a batch for each run of the queue that goes to the same
+	// users; each is serialized once, and the compressed forms are made
+	// from these bytes
+	for(BroadcastQueue::const_iterator i = q.begin(); i != q.end(); ) {
+		BroadcastQueue::const_iterator j = i;
+		while(++j != q.end() && j->need == i->need)
+			;
+		sendBatch(serialize(i, j), i->need);
+		i = j;
+	}
+}
+
+Buffer::MutablePtr ClientManager::serialize(BroadcastQueue::const_iterator first,
+		BroadcastQueue::const_iterator last) throw()
+{
+	typedef BroadcastQueue::const_iterator QI;
+	size_t n = 0;
+	for(QI i = first; i != last; ++i)
+		n += i->cmd.toString().size();
+	Buffer::MutablePtr b(new Buffer);
+	b->reserve(n);
+	for(QI i = first; i != last; ++i)
+		b->append(i->cmd);
+	return b;
+}
+
+bool ClientManager::isActive(sid_type sid) throw()
+{
+	UserInfo* u = getUserInfo(sid);
+	// don't know, so don't hold anything back
+	if(!u)
+		return true;
+	return u->hasSupport("TCP4") || u->hasSupport("TCP6");
+}
+
+void ClientManager::sendBatch(const Buffer::Ptr& tmp, int need, const uint8_t* tth) throw()
+{
+	bool use_z = CompressionManager::instance()->worthCompressing(tmp->size());
 
-	Buffer::MutablePtr tmp(new Buffer);
-	ZBuffer::MutablePtr ztmp;
-	for(QI i = broadcastQueue.begin(); i != broadcastQueue.end(); ++i)
-		tmp->append(*i);
+	// each compressed once, for the first connection that wants it
+	Buffer::Ptr ztmp;
+	ZBroadcast::Segment zseg;
+	bool zdone = false;
 
-	bool use_z = tmp->size() > 1024; // FIXME user-settable
+	LocalUsers::size_type n = localUsers.size();
 
-	if(use_z) {
-		ztmp.reset(new ZBuffer);
-		for(QI i = broadcastQueue.begin(); i != broadcastQueue.end(); ++i)
-			ztmp->append(*i);
-		ztmp->finalize();
+	// how much of it each socket has taken already, if the writes were
+	// split over the WorkerPool
+	vector<int> sent;
+	if(fanOut && n >= fanOut && WorkerPool::instance()->hasWorkers()) {
+		if(use_z)
+			ztmp = compressBatch(tmp, use_z);
+		sent.resize(n, -1);
+		LocalUsers::size_type parts = WorkerPool::instance()->getWorkers() + 1;
+		vector<Job*> jobs;
+		for(LocalUsers::size_type i = 0; i < parts; ++i)
+			jobs.push_back(new FanOutJob(localUsers, n * i / parts, n * (i + 1) / parts,
+					need, *tmp, use_z ? ztmp.get() : NULL, tth, sent));
+		WorkerPool::instance()->runAll(jobs);
 	}
 
-	typedef LocalUsers::const_iterator CI;
-	for(CI i = localUsers.begin(); i != localUsers.end(); ++i)
-		if(use_z && i->second->hasSupport("ZLIF"))
-			i->second->getSocket()->writeb(ztmp);
-		else
-			i->second->getSocket()->writeb(tmp);
+	for(LocalUsers::size_type i = 0; i < n; ++i) {
+		if((localUsers.getFlags(i) & need) != need)
+			continue;
+		if(tth && localUsers.getBloom(i) && !localUsers.getBloom(i)->match(tth))
+			continue;
+		ADCSocket* s = localUsers.getSocket(i);
+		if(s->hasZStream()) {
+			if(!zdone) {
+				zdone = true;
+				try {
+					zseg = zshared->compress(*tmp);
+				} catch(const runtime_error& e) {
+					// each stream compresses it by itself instead
+					Logs::err << "broadcast compression failed: " << e.what() << endl;
+				}
+			}
+			s->writeb(tmp, zseg);
+		} else {
+			const Buffer::Ptr* b = &tmp;
+			if(use_z && (localUsers.getFlags(i) & LocalUsers::ZLIF)) {
+				if(!ztmp)
+					ztmp = compressBatch(tmp, use_z);
+				b = &ztmp;
+			}
+			if(!sent.empty() && sent[i] >= 0)
+				s->writeRest(*b, sent[i]);
+			else
+				s->writeb(*b);
+		}
+	}
+}
 
-	broadcastQueue.clear();
+Buffer::Ptr ClientManager::compressBatch(const Buffer::Ptr& tmp, bool& use_z) throw()
+{
+	if(WorkerPool::instance()->hasWorkers()
+			&& CompressionManager::instance()->worthOffloading(tmp->size())) {
+		// big enough to hold up the event loop; everything sent to
+		// these clients after it waits until it's done
+		try {
+			boost::shared_ptr<Deflater> z(new Deflater(CompressionManager::instance()->getLevel()));
+			DeferredBuffer::MutablePtr d(new DeferredBuffer);
+			WorkerPool::instance()->submit(new CompressJob(d, z, tmp, true, true));
+			return d;
+		} catch(const runtime_error& e) {
+			Logs::err << "broadcast compression failed: " << e.what() << endl;
+			use_z = false;
+			return tmp;
+		}
+	}
+	try {
+		long cpu = CompressionManager::cpuTime();
+		int level = CompressionManager::instance()->getLevel();
+		if(!zbatch) {
+			zbatch = new Deflater(level);
+		} else {
+			// the last batch finished the stream, and zlib won't change
+			// some levels on a finished one
+			zbatch->reset();
+			zbatch->setLevel(level);
+		}
+		Buffer::Ptr ztmp(new ZBuffer(*tmp, *zbatch));
+		CompressionManager::instance()->record(tmp->size(), ztmp->size(),
+				CompressionManager::cpuTime() - cpu);
+		return ztmp;
+	} catch(const runtime_error& e) {
+		Logs::err << "broadcast compression failed: " << e.what() << endl;
+		use_z = false;
+		return tmp;
+	}
 }
 
 void ClientManager::broadcastFeature(const Command& cmd) throw()
 {
 	Buffer::Ptr tmp(new Buffer(cmd));
 	const string& feat = cmd.getFeatures();
+
+	// what users must and mustn't have, as LocalUsers feature bits
+	uint32_t want = 0, avoid = 0;
+	for(string::const_iterator j = feat.begin(); j != feat.end(); j += 5) {
+		string f(j + 1, j + 5);
+		uint32_t bit = localUsers.getFeatureBit(f);
+		if(!bit) {
+			broadcastFeatureSlow(cmd, tmp);
+			return;
+		}
+		if(*j == '+')
+			want |= bit;
+		else
+			avoid |= bit;
+	}
+
+	for(LocalUsers::size_type i = 0, n = localUsers.size(); i < n; ++i) {
+		uint32_t f = localUsers.getFeatures(i);
+		if((f & want) == want && !(f & avoid))
+			localUsers.getSocket(i)->writeb(tmp);
+	}
+}
+
+void ClientManager::broadcastFeatureSlow(const Command& cmd, const Buffer::Ptr& tmp) throw()
+{
+	const string& feat = cmd.getFeatures();
 	typedef LocalUsers::const_iterator CI;
 
 	for(CI i = localUsers.begin(); i != localUsers.end(); ++i) {
-		Client* c = i->second;
+		Client* c = *i;
 		bool send = true;
 		for(string::const_iterator j = feat.begin(); j != feat.end(); j += 5) {
-			if(*j == '+' && !c->getUserInfo()->hasSupport(string(j+1, j+5))
-					|| *j == '-' && c->getUserInfo()->hasSupport(string(j+1, j+5)))
-				Logs::line << "not sending to user " << ADC::fromSid(c->getSid())
-						<< " because of feature " << string(j+1, j+5) << endl;
+			bool has = c->getUserInfo()->hasSupport(string(j+1, j+5));
+			if((*j == '+' && !has) || (*j == '-' && has)) {
 				send = false;
 				break;
+			}
 		}
 		if(send)
 			c->getSocket()->writeb(tmp);
@@ -182,9 +540,8 @@ void ClientManager::broadcastFeature(const Command& cmd) throw()
 
 void ClientManager::direct(const Command& cmd) throw()
 {
-	LocalUsers::const_iterator i = localUsers.find(cmd.getDest());
-	if(i != localUsers.end()) {
-		i->second->send(cmd);
+	if(Client* c = localUsers.find(cmd.getDest())) {
+		c->send(cmd);
 		return;
 	}
 	RemoteUsers::const_iterator j = remoteUsers.find(cmd.getDest());
@@ -7,8 +7,11 @@
 #include "Buffer.h"
 #include "Command.h"
 #include "EventManager.h"
+#include "LocalUsers.h"
+#include "NickIndex.h"
 #include "Singleton.h"
 
+#include <list>
 #include <string>
 #include <vector>
 
@@ -16,15 +19,34 @@ namespace qhub {
 
 class ClientManager : public Singleton<ClientManager>, public EventListener {
 public:
+	// a SID for a new connection; INVALID_SID if the hub is full
+	sid_type allocSid() throw();
+	void releaseSid(sid_type sid) throw() { localUsers.release(sid); }
+
 	bool hasClient(sid_type sid, bool localonly = false) const throw();
 	void addLocalClient(sid_type sid, Client* client) throw();
 	void userUpdated(sid_type sid, UserInfo const&) throw();
+	// after c's UserInfo has changed
+	void refresh(Client* c) throw();
 	void addRemoteClient(sid_type sid, UserInfo const&) throw();
 	void removeClient(sid_type sid) throw();
+	// removes all users of the hub, telling local users in one go
+	void netsplit(sid_type hsid) throw();
 	void getAllInHub(sid_type, std::vector<sid_type>&) const throw();
-
-	void getUserList(ConnectionBase*) throw();
-
+	// folds the bloom filters of all local users into agg; false if some
+	// have none
+	bool foldBlooms(HashBloom& agg) const throw();
+	// NULL if there is no such user (any more)
+	UserInfo* getUserInfo(sid_type sid) throw();
+
+	// remoteOnly leaves out our own users
+	void getUserList(ConnectionBase*, bool remoteOnly = false) throw();
+	// persistent ZLIF stream for the rest of the session, if enabled
+	void startZStream(ConnectionBase*) throw();
+
+	// chat goes out at once; INF and SCH wait up to their delay (or until
+	// enough has piled up) to be sent together with others, except TTH
+	// searches, which only go to users that may have the file
 	void broadcast(const Command&) throw();
 	virtual void onTimer(int) throw();
 	void purgeQueue() throw();
@@ -32,27 +54,78 @@ public:
 	void broadcastFeature(const Command&) throw();
 	void direct(const Command&) throw();
 
-	bool hasNick(const std::string& nick) const throw() { return nicks.count(nick); }
+	// nicks are compared case folded; see NickIndex
+	bool hasNick(const std::string& nick, sid_type except = INVALID_SID) const throw() { return nicks.has(nick, except); }
+	// appends the users whose nick starts with prefix, up to max of them
+	void findNicks(const std::string& prefix, std::vector<sid_type>& ret,
+			std::vector<sid_type>::size_type max = -1) const throw() { nicks.findPrefix(prefix, ret, max); }
 	bool hasCid(const std::string& cid) const throw() { return cids.count(cid); }
 
-	typedef QHUB_FAST_MAP<sid_type, Client*> LocalUsers;
 	typedef QHUB_FAST_MAP<sid_type, UserInfo*> RemoteUsers;
 private:
 	friend class Singleton<ClientManager>;
 
-	void fillUserListBuf(Buffer::MutablePtr);
-
 	LocalUsers localUsers;
 
 	RemoteUsers remoteUsers;
+	// the same, by the hub part of their SID
+	typedef QHUB_FAST_SET<sid_type> HubUsers;
+	typedef QHUB_FAST_MAP<sid_type, HubUsers> HubIndex;
+	HubIndex hubUsers;
 
-	QHUB_FAST_SET<std::string> nicks;
+	NickIndex nicks;
 	QHUB_FAST_SET<std::string> cids;
 
-	std::vector<Command> broadcastQueue;
-
-	ClientManager() throw() {}
-	~ClientManager() throw() {}
+	// how long a broadcast may wait in the queue, by kind
+	enum Delay { DELAY_CHAT, DELAY_INF, DELAY_SCH, DELAY_LAST };
+	static Delay delayOf(const Command&) throw();
+	int delays[DELAY_LAST];	// milliseconds
+
+	// a queued broadcast, and the LocalUsers::Flags a user needs to get it
+	// (searches from passive users are only for active ones); kept in one
+	// queue so nothing overtakes what was said before it
+	struct Queued {
+		Queued(const Command& c, int n) throw() : cmd(c), need(n) {}
+		Command cmd;
+		int need;
+	};
+	typedef std::list<Queued> BroadcastQueue;
+	BroadcastQueue broadcastQueue;
+	// each user's queued INF, which later ones are merged into
+	QHUB_FAST_MAP<sid_type, BroadcastQueue::iterator> queuedInfs;
+	// users whose first INF hasn't gone out to our users yet, and who
+	// weren't in a user list sent since; if they quit before it does,
+	// nobody needs to hear of them at all
+	QHUB_FAST_SET<sid_type> joining;
+	// bytes in the queue; at batchSize it's sent whatever the deadline
+	size_t queuedBytes;
+	size_t batchSize;
+	// users at which broadcast writes are done by the WorkerPool; 0 is never
+	LocalUsers::size_type fanOut;
+	// when the first thing in the queue must go out
+	timeval deadline;
+	// users with something in the queue; what they send next can't be sent
+	// past it
+	QHUB_FAST_SET<sid_type> queuedFrom;
+	// shared by all persistent ZLIF streams; NULL if they're disabled
+	ZBroadcast* zshared;
+	// reused for every IZON ... IZOF broadcast batch
+	Deflater* zbatch;
+
+	static Buffer::MutablePtr serialize(BroadcastQueue::const_iterator first,
+			BroadcastQueue::const_iterator last) throw();
+	// to the users with all of the LocalUsers::Flags in need and, if there's
+	// a tth, whose bloom filter (if any) may have it
+	void sendBatch(const Buffer::Ptr&, int need = 0, const uint8_t* tth = NULL) throw();
+	// batch compressed for ZLIF; use_z is cleared if that failed
+	Buffer::Ptr compressBatch(const Buffer::Ptr& batch, bool& use_z) throw();
+	// unknown users count as active
+	bool isActive(sid_type sid) throw();
+	// for features LocalUsers has no bit for
+	void broadcastFeatureSlow(const Command&, const Buffer::Ptr&) throw();
+
+	ClientManager() throw();
+	~ClientManager() throw();
 };
 
 } // namespace qhub
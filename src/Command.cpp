@@ -37,6 +37,16 @@ void Command::initNumPosParams() throw()
 	numPosParams[ZOF] = 0;
 	// user command extension
 	numPosParams[CMD] = 1;
+	// interhub bloom filters
+	numPosParams[BLO] = 3;
+	// interhub delta resync
+	numPosParams[HAS] = 2;
+	numPosParams[VER] = 3;
+	// interhub framing
+	numPosParams[FRM] = 0;
+	// interhub round trips
+	numPosParams[PIN] = 1;
+	numPosParams[PON] = 1;
 }
 
 Command::Command(const Command& rhs) throw()
@@ -204,6 +214,20 @@ Command::ConstParamIter Command::find(const string& k, ConstParamIter start) con
 	return start;
 }
 
+void Command::merge(const Command& rhs) throw()
+{
+	for(ConstParamIter i = rhs.begin() + rhs.getOffset(); i != rhs.end(); ++i) {
+		if(i->size() < 2)
+			continue;
+		ParamIter j = find(i->substr(0, 2));
+		if(j != end())
+			*j = *i;
+		else
+			params.push_back(*i);
+	}
+	setDirty();
+}
+
 const string& Command::toString() const throw()
 {
 	if(dirty) {
@@ -44,7 +44,17 @@ public:
 		MAKE_CMD(ZON, 'Z','O','N'),
 		MAKE_CMD(ZOF, 'Z','O','F'),
 		// user command extension
-		MAKE_CMD(CMD, 'C','M','D')
+		MAKE_CMD(CMD, 'C','M','D'),
+		// interhub bloom filters
+		MAKE_CMD(BLO, 'B','L','O'),
+		// interhub delta resync
+		MAKE_CMD(HAS, 'H','A','S'),
+		MAKE_CMD(VER, 'V','E','R'),
+		// interhub framing
+		MAKE_CMD(FRM, 'F','R','M'),
+		// interhub round trips
+		MAKE_CMD(PIN, 'P','I','N'),
+		MAKE_CMD(PON, 'P','O','N')
 	};
 #undef MAKE_CMD
 
@@ -82,6 +92,9 @@ public:
 	ParamIter find(const std::string& k) throw() { return find(k, begin() + getOffset()); }
 	ConstParamIter find(const std::string& k) const throw() { return find(k, begin() + getOffset()); }
 
+	// takes on rhs's named params, replacing ours with the same names
+	void merge(const Command& rhs) throw();
+
 	const std::string& toString() const throw();
 
 	sid_type getSource() const throw() { return from; };
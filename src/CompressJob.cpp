@@ -0,0 +1,54 @@
+// vim:ts=4:sw=4:noet
+#include "CompressJob.h"
+
+#include "CompressionManager.h"
+#include "Deflater.h"
+#include "Logs.h"
+
+using namespace std;
+using namespace qhub;
+
+CompressJob::CompressJob(DeferredBuffer::MutablePtr o, boost::shared_ptr<Deflater> z,
+		Buffer::Ptr i, bool b, bool e) throw()
+		: out(o), zstream(z), in(i), begin(b), end(e), usecs(0), failed(false)
+{
+}
+
+void CompressJob::run() throw()
+{
+	long cpu = CompressionManager::cpuTime();
+	try {
+		// not Command: that isn't safe to use off the event loop
+		if(begin) {
+			// so other end knows zlib stream is starting
+			static const char zon[] = "IZON\n";
+			result.insert(result.end(), zon, zon + sizeof(zon) - 1);
+		}
+		result.reserve(result.size() + in->size() / 2 + 256);
+		zstream->write(in->data(), in->size(), result);
+		if(end) {
+			static const char zof[] = "IZOF\n";
+			zstream->write(zof, sizeof(zof) - 1, result, Z_FINISH);
+		} else {
+			zstream->flush(result, Z_SYNC_FLUSH);
+		}
+	} catch(const runtime_error&) {
+		failed = true;
+	}
+	usecs = CompressionManager::cpuTime() - cpu;
+}
+
+void CompressJob::done() throw()
+{
+	if(failed) {
+		Logs::err << "compression failed, sending " << in->size() << " bytes uncompressed" << endl;
+		// a whole stream can just go out plain instead; part of one can't
+		// be recovered from, and the other end will have to cope
+		result.clear();
+		if(begin && end)
+			result.assign(in->data(), in->data() + in->size());
+	} else {
+		CompressionManager::instance()->record(in->size(), result.size(), usecs);
+	}
+	out->fill(result);
+}
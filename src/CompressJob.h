@@ -0,0 +1,44 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_COMPRESSJOB_H
+#define QHUB_COMPRESSJOB_H
+
+#include "qhub.h"
+#include "Buffer.h"
+#include "DeferredBuffer.h"
+#include "WorkerPool.h"
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace qhub {
+
+/*
+ * Compresses plain ADC into a DeferredBuffer, on a worker if there are
+ * any.  begin puts IZON in front, end closes the stream with IZOF; without
+ * end the output is sync-flushed, so one stream can be continued by the
+ * next job (which must not be submitted until this one is done).
+ */
+class CompressJob : public Job {
+public:
+	CompressJob(DeferredBuffer::MutablePtr out, boost::shared_ptr<Deflater> zstream,
+			Buffer::Ptr in, bool begin, bool end) throw();
+	virtual ~CompressJob() throw() {}
+
+	virtual void run() throw();
+	virtual void done() throw();
+
+private:
+	DeferredBuffer::MutablePtr out;
+	boost::shared_ptr<Deflater> zstream;
+	Buffer::Ptr in;
+	bool begin, end;
+
+	std::vector<uint8_t> result;
+	long usecs;
+	bool failed;
+};
+
+} // namespace qhub
+
+#endif // QHUB_COMPRESSJOB_H
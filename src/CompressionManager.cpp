@@ -0,0 +1,225 @@
+// vim:ts=4:sw=4:noet
+#include "CompressionManager.h"
+
+#include "Logs.h"
+#include "Settings.h"
+#include "Util.h"
+#include "XmlTok.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <zlib.h>
+
+using namespace std;
+using namespace qhub;
+
+// seconds between adjustments
+#define INTERVAL 5
+
+CompressionManager::CompressionManager() throw()
+		: level(Z_BEST_COMPRESSION), threshold(1024),
+		autoLevel(true), autoThreshold(true),
+		minLevel(Z_BEST_SPEED), maxLevel(Z_BEST_COMPRESSION),
+		minThreshold(256), maxThreshold(64 * 1024), cpuLow(30), cpuHigh(70),
+		offload(16 * 1024), links(true),
+		lastCpu(cpuTime()), cpuLoad(0), smallRatio(0.5),
+		batches(0), plainBytes(0), zBytes(0), zUsecs(0)
+{
+	gettimeofday(&lastWall, NULL);
+
+	XmlTok* p = Settings::instance()->getConfig("__compression");
+	static const char* const names[] = {
+		"minlevel", "maxlevel", "minthreshold", "maxthreshold",
+		"cpulow", "cpuhigh", "offload", "links", "level", "threshold", NULL
+	};
+	// set() saves everything, so read them all before the first goes in
+	vector<pair<const char*, string> > vals;
+	for(const char* const* n = names; *n; ++n) {
+		const string& v = p->getAttr(*n);
+		if(!v.empty())
+			vals.push_back(make_pair(*n, v));
+	}
+	// a bound only fits between its pair, which may not be in yet, so
+	// whatever doesn't fit gets a second go once the rest is
+	vector<pair<const char*, string> > later;
+	for(vector<pair<const char*, string> >::iterator i = vals.begin(); i != vals.end(); ++i) {
+		if(!set(i->first, i->second))
+			later.push_back(*i);
+	}
+	for(vector<pair<const char*, string> >::iterator i = later.begin(); i != later.end(); ++i) {
+		if(!set(i->first, i->second))
+			Logs::err << "ignoring bad compression setting " << i->first << "=\"" << i->second << "\"\n";
+	}
+
+	EventManager::instance()->addTimer(this, 0, INTERVAL);
+}
+
+long CompressionManager::cpuTime() throw()
+{
+	struct rusage ru;
+#ifdef RUSAGE_THREAD
+	getrusage(RUSAGE_THREAD, &ru);
+#else
+	getrusage(RUSAGE_SELF, &ru);
+#endif
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000L
+			+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+void CompressionManager::record(size_t plainSize, size_t zSize, long usecs) throw()
+{
+	++batches;
+	plainBytes += plainSize;
+	zBytes += zSize;
+	zUsecs += usecs;
+	// is the threshold about right?
+	if(plainSize && plainSize < threshold * 2)
+		smallRatio = smallRatio * 0.9 + 0.1 * zSize / plainSize;
+}
+
+void CompressionManager::onTimer(int) throw()
+{
+	long cpu = cpuTime();
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	long wall = (now.tv_sec - lastWall.tv_sec) * 1000000L + now.tv_usec - lastWall.tv_usec;
+	if(wall > 0)
+		cpuLoad = (cpu - lastCpu) * 100 / wall;
+	lastCpu = cpu;
+	lastWall = now;
+
+	if(cpuLoad > cpuHigh) {
+		// CPU-bound: trade ratio for speed
+		if(autoLevel)
+			level = max(minLevel, level - 1);
+		if(autoThreshold)
+			threshold = min(maxThreshold, threshold * 2);
+	} else if(cpuLoad < cpuLow) {
+		// spare CPU: spend it on bandwidth
+		if(autoLevel)
+			level = min(maxLevel, level + 1);
+		if(autoThreshold) {
+			// ...unless batches this small hardly shrink anyway
+			if(smallRatio > 0.85)
+				threshold = min(maxThreshold, threshold * 2);
+			else
+				threshold = max(minThreshold, threshold / 2);
+		}
+	}
+
+	EventManager::instance()->addTimer(this, 0, INTERVAL);
+}
+
+bool CompressionManager::set(const string& name, const string& value) throw()
+{
+	int v;
+	bool a = value == "auto";
+	try {
+		v = a ? 0 : Util::toInt(value);
+	} catch(const boost::bad_lexical_cast&) {
+		return false;
+	}
+	if(v < 0)
+		return false;
+
+	if(name == "level") {
+		if(!a && (v < Z_BEST_SPEED || v > Z_BEST_COMPRESSION))
+			return false;
+		autoLevel = a;
+		if(!a)
+			level = v;
+	} else if(name == "threshold") {
+		autoThreshold = a;
+		if(!a)
+			threshold = v;
+	} else if(a) {
+		return false;
+	} else if(name == "minlevel" || name == "maxlevel") {
+		if(v < Z_BEST_SPEED || v > Z_BEST_COMPRESSION)
+			return false;
+		// each bound has to stay on its side of the other, or the
+		// tuning in onTimer clamps into nothing
+		if(name == "minlevel" ? v > maxLevel : v < minLevel)
+			return false;
+		(name == "minlevel" ? minLevel : maxLevel) = v;
+	} else if(name == "minthreshold") {
+		if(size_t(v) > maxThreshold)
+			return false;
+		minThreshold = v;
+	} else if(name == "maxthreshold") {
+		if(size_t(v) < minThreshold)
+			return false;
+		maxThreshold = v;
+	} else if(name == "cpulow") {
+		if(v > cpuHigh)
+			return false;
+		cpuLow = v;
+	} else if(name == "cpuhigh") {
+		if(v < cpuLow)
+			return false;
+		cpuHigh = v;
+	} else if(name == "offload") {
+		offload = v;
+	} else if(name == "links") {
+		if(v > 1)
+			return false;
+		links = v;
+	} else {
+		return false;
+	}
+
+	if(autoLevel)
+		level = max(minLevel, min(maxLevel, level));
+	if(autoThreshold)
+		threshold = max(minThreshold, min(maxThreshold, threshold));
+	save();
+	return true;
+}
+
+void CompressionManager::save() const throw()
+{
+	XmlTok* p = Settings::instance()->getConfig("__compression");
+	p->setAttr("level", autoLevel ? "auto" : Util::toString(level));
+	p->setAttr("threshold", autoThreshold ? "auto" : Util::toString(threshold));
+	p->setAttr("minlevel", Util::toString(minLevel));
+	p->setAttr("maxlevel", Util::toString(maxLevel));
+	p->setAttr("minthreshold", Util::toString(minThreshold));
+	p->setAttr("maxthreshold", Util::toString(maxThreshold));
+	p->setAttr("cpulow", Util::toString(cpuLow));
+	p->setAttr("cpuhigh", Util::toString(cpuHigh));
+	p->setAttr("offload", Util::toString(offload));
+	p->setAttr("links", links ? "1" : "0");
+}
+
+string CompressionManager::getSettings() const throw()
+{
+	ostringstream os;
+	os << "level " << (autoLevel ? "auto" : Util::toString(level))
+			<< " (" << minLevel << '-' << maxLevel << ")\n"
+			<< "threshold " << (autoThreshold ? "auto" : Util::toString(threshold))
+			<< " (" << minThreshold << '-' << maxThreshold << " bytes)\n"
+			<< "cpulow " << cpuLow << "%, cpuhigh " << cpuHigh << "%\n"
+			<< "offload " << offload << " bytes\n"
+			<< "links " << (links ? "1" : "0");
+	return os.str();
+}
+
+string CompressionManager::getStats() const throw()
+{
+	ostringstream os;
+	os << "level now " << level << ", threshold now " << threshold << " bytes\n"
+			<< "CPU load " << cpuLoad << "% over the last " << INTERVAL << " seconds\n"
+			<< batches << " batches, " << plainBytes << " bytes compressed to " << zBytes;
+	if(plainBytes)
+		os << " (" << zBytes * 100 / plainBytes << "%)";
+	os << "\n" << zUsecs / 1000 << " ms spent compressing";
+	if(plainBytes)
+		os << " (" << zUsecs * 1000 / (long long)plainBytes << " ns/byte)";
+	os << "\nbatches near the threshold shrink to " << int(smallRatio * 100) << '%';
+	return os.str();
+}
@@ -0,0 +1,80 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_COMPRESSIONMANAGER_H
+#define QHUB_COMPRESSIONMANAGER_H
+
+#include "qhub.h"
+#include "EventManager.h"
+#include "Singleton.h"
+
+#include <string>
+
+#include <sys/time.h>
+
+namespace qhub {
+
+/*
+ * Decides how hard to compress.  Every few seconds it looks at how much of
+ * the time we spent on the CPU: when we're busy, the zlib level goes down
+ * and the size a broadcast batch must have before it's compressed at all
+ * goes up; when we're idle, the other way round.  Only the event loop's
+ * own CPU time counts, the WorkerPool threads have CPUs of their own.
+ * Small batches that don't shrink much push the threshold up too.  Level
+ * and threshold can each be fixed in <__compression> instead, and
+ * everything can be changed at runtime.
+ */
+class CompressionManager : public Singleton<CompressionManager>, public EventListener {
+public:
+	int getLevel() const throw() { return level; }
+	bool worthCompressing(size_t plainSize) const throw() { return plainSize > threshold; }
+	// big enough to hand to the WorkerPool instead of doing it inline
+	bool worthOffloading(size_t plainSize) const throw() { return plainSize >= offload; }
+	// interhub links that take ZLIF get a stream for good after the INF list
+	bool compressLinks() const throw() { return links; }
+
+	// a batch of plainSize bytes came out as zSize bytes, in usecs of CPU
+	void record(size_t plainSize, size_t zSize, long usecs) throw();
+
+	// runtime settings, also saved to qhub.xml; false if the name or value
+	// is no good
+	bool set(const std::string& name, const std::string& value) throw();
+	std::string getSettings() const throw();
+	std::string getStats() const throw();
+
+	virtual void onTimer(int) throw();
+
+	// microseconds of CPU used by the calling thread so far
+	static long cpuTime() throw();
+
+private:
+	friend class Singleton<CompressionManager>;
+
+	// what we pick
+	int level;
+	size_t threshold;
+
+	// settings
+	bool autoLevel, autoThreshold;
+	int minLevel, maxLevel;
+	size_t minThreshold, maxThreshold;
+	int cpuLow, cpuHigh;	// percent
+	size_t offload;
+	bool links;
+
+	// measurements
+	long lastCpu;
+	struct timeval lastWall;
+	int cpuLoad;			// percent, over the last interval
+	double smallRatio;		// of batches near the threshold, averaged
+	unsigned long batches;
+	unsigned long long plainBytes, zBytes;
+	long long zUsecs;
+
+	void save() const throw();
+
+	CompressionManager() throw();
+	~CompressionManager() throw() {}
+};
+
+} // namespace qhub
+
+#endif // QHUB_COMPRESSIONMANAGER_H
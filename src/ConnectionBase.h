@@ -10,6 +10,7 @@
 
 #include <set>
 #include <string>
+#include <vector>
 
 #include <boost/noncopyable.hpp>
 
@@ -36,8 +37,10 @@ public:
 	 */
 	explicit ConnectionBase(ADCSocket* s = NULL) throw();
 	virtual ~ConnectionBase() throw();
-	void send(const Command& cmd) { sock->write(cmd.toString(), 0); };
+	virtual void send(const Command& cmd) { sock->write(cmd.toString(), 0); };
 	bool hasSupport(const std::string& feat) const throw() { return supp.count(feat); }
+	// preset dictionary both ends of this connection have, if any
+	virtual const std::string* getZDictionary() const throw() { return NULL; }
 	void updateSupports(const Command& cmd) throw();
 	void dispatch(const Command& cmd) throw();
 
@@ -52,6 +55,8 @@ public:
 	virtual void doWarning(std::string const& msg) throw() = 0;
 
 	virtual void onLine(Command& cmd) throw(command_error) = 0;
+	// what ADCSocket::expectData() asked for
+	virtual void onData(std::vector<uint8_t>&) throw(command_error) {}
 	virtual void onConnected() throw() = 0;
 	virtual void onDisconnected(std::string const& clue) throw() = 0;
 
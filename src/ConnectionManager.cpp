@@ -3,31 +3,53 @@
 
 #include "ADCSocket.h"
 #include "Client.h"
+#include "Hub.h"
 #include "InterHub.h"
+#include "InterLink.h"
 #include "Logs.h"
 #include "ServerSocket.h"
 #include "Settings.h"
+#include "Supervisor.h"
+
+#include <algorithm>
+#include <ctime>
 
 #include <boost/lambda/construct.hpp> // for delete_ptr
 
 using namespace qhub;
 using namespace std;
 
-ConnectionManager::ConnectionManager() throw()
+// seconds before a link that's still connecting no longer keeps others
+// from starting
+#define LINK_SETUP_TIME 60
+
+ConnectionManager::ConnectionManager() throw() : ticking(false)
 {
 	XmlTok* p = Settings::instance()->getConfig("__connections");
 	XmlTok* pp;
 
-	// we only want to do this the first time, not on reloads
-	p->findChild("interconnect");
-	while((pp = p->getNextChild())) {
-		const string& host = pp->getAttr("host");
-		int port = Util::toInt(pp->getAttr("port"));
-		const string& pass = pp->getAttr("password");
-		if(host.empty() || port <= 0 || port > 65535)
-			continue;
-		Logs::stat << "Connecting to " << host << ':' << port << endl;
-		openInterConnection(host, port, pass);
+	retryMin = max(1, Settings::getInt(p, "retrymin", 5));
+	retryMax = max(retryMin, Settings::getInt(p, "retrymax", 10 * 60));
+	maxLinking = max(1, Settings::getInt(p, "maxlinking", 2));
+
+	// links to the other workers, if we're one
+	const Supervisor::Links& w = Supervisor::instance()->getLinks();
+	for(Supervisor::Links::const_iterator i = w.begin(); i != w.end(); ++i)
+		openWorkerLink(i->first, i->second);
+
+	// we only want to do this the first time, not on reloads; the other
+	// workers are reached through the first
+	if(Supervisor::instance()->getIndex() == 0) {
+		p->findChild("interconnect");
+		while((pp = p->getNextChild())) {
+			const string& host = pp->getAttr("host");
+			int port = Util::toInt(pp->getAttr("port"));
+			const string& pass = pp->getAttr("password");
+			if(host.empty() || port <= 0 || port > 65535)
+				continue;
+			if(!openInterConnection(host, port, pass))
+				Logs::err << "ignoring second interconnect to " << host << ':' << port << endl;
+		}
 	}
 	load();
 }
@@ -48,6 +70,8 @@ void ConnectionManager::load() throw()
 			openClientPort(port);
 	}
 
+	if(Supervisor::instance()->getIndex() != 0)
+		return;
 	p->findChild("interport");
 	while((pp = p->getNextChild())) {
 		int port = Util::toInt(pp->getData());
@@ -112,11 +136,105 @@ void ConnectionManager::acceptLeaf(int fd, Socket::Domain d)
 	new Client(new ADCSocket(fd, d));
 }
 
-void ConnectionManager::openInterConnection(const string& host, int port, const string& pass) throw()
+bool ConnectionManager::openInterConnection(const string& host, int port, const string& pass) throw()
 {
-	//we don't want this added anywhere until it's functional
-	//it will add itself once it's ready to carry traffic
-	new InterHub(host, (short)port, pass);
+	// two would only keep knocking each other off
+	for(Links::const_iterator i = links.begin(); i != links.end(); ++i)
+		if((*i)->getHost() == host && (*i)->getPort() == (short)port)
+			return false;
+	links.push_back(new InterLink(host, (short)port, pass));
+	superviseLinks();
+	return true;
+}
+
+bool ConnectionManager::closeInterConnection(const string& host, int port) throw()
+{
+	for(Links::iterator i = links.begin(); i != links.end(); ++i) {
+		InterLink* l = *i;
+		if(l->getHost() != host || l->getPort() != (short)port)
+			continue;
+		links.erase(i);
+		if(l->getHub())
+			l->getHub()->unlink();
+		Logs::stat << "Link to " << host << ':' << port << " removed" << endl;
+		delete l;
+		// it may have kept another from starting
+		superviseLinks();
+		return true;
+	}
+	return false;
+}
+
+void ConnectionManager::openWorkerLink(int fd, bool first) throw()
+{
+	ADCSocket* s = new ADCSocket(fd, Socket::UNIX);
+	if(first)
+		new InterHub(s, Hub::instance()->getInterPass());
+	else
+		new InterHub(s);
+}
+
+void ConnectionManager::linkUp(InterLink* l) throw()
+{
+	Logs::stat << "Link to " << l->getHost() << ':' << l->getPort() << " is up" << endl;
+	l->up(time(NULL));
+	superviseLinks();
+}
+
+void ConnectionManager::linkDown(InterLink* l, const string& why) throw()
+{
+	l->down(time(NULL), why, retryMin, retryMax);
+	Logs::err << "Link to " << l->getHost() << ':' << l->getPort() << " down ("
+			<< why << "), trying again in " << l->getNext() - time(NULL) << " s" << endl;
+	superviseLinks();
+}
+
+string ConnectionManager::getLinkStatus() const throw()
+{
+	time_t now = time(NULL);
+	string ret;
+	for(Links::const_iterator i = links.begin(); i != links.end(); ++i) {
+		if(!ret.empty())
+			ret += '\n';
+		ret += (*i)->getStatus(now);
+	}
+	return ret;
+}
+
+void ConnectionManager::onTimer(int) throw()
+{
+	ticking = false;
+	superviseLinks();
+}
+
+void ConnectionManager::superviseLinks() throw()
+{
+	time_t now = time(NULL);
+	int linking = 0;
+	for(Links::const_iterator i = links.begin(); i != links.end(); ++i)
+		if((*i)->getState() == InterLink::CONNECTING && now - (*i)->getNext() < LINK_SETUP_TIME)
+			++linking;
+
+	bool waiting = false;
+	for(Links::const_iterator i = links.begin(); i != links.end(); ++i) {
+		InterLink* l = *i;
+		if(l->getState() != InterLink::WAITING)
+			continue;
+		if(l->getNext() > now || linking >= maxLinking) {
+			waiting = true;
+			continue;
+		}
+		Logs::stat << "Connecting to " << l->getHost() << ':' << l->getPort() << endl;
+		++linking;
+		//we don't want this added anywhere until it's functional
+		//it will add itself once it's ready to carry traffic
+		l->connecting(now, new InterHub(l));
+	}
+	// a second is as fine as backoffs get
+	if(waiting && !ticking) {
+		ticking = true;
+		EventManager::instance()->addTimer(this, 0, 1);
+	}
 }
 
 void ConnectionManager::acceptInterHub(int fd, Socket::Domain d)
@@ -2,6 +2,7 @@
 #define QHUB_CONNECTIONMANAGER_H
 
 #include "qhub.h"
+#include "EventManager.h"
 #include "Singleton.h"
 #include "Socket.h"
 
@@ -10,11 +11,32 @@
 
 namespace qhub {
 
-class ConnectionManager : public Singleton<ConnectionManager> {
+/*
+ * Listening ports, and the outgoing interhub links we keep up (see
+ * InterLink).  At most maxlinking (<__connections>) of those are being set
+ * up at a time, so a hub coming back isn't swamped by everybody's INF
+ * lists at once; retrymin and retrymax bound the backoff between tries.
+ */
+class ConnectionManager : public Singleton<ConnectionManager>, public EventListener {
 public:
 	void openClientPort(int port);
 	void openInterPort(int port);
-	void openInterConnection(const std::string&, int port, const std::string&) throw();
+	// a link to keep up from now on; false if there's one to that host
+	// and port already
+	bool openInterConnection(const std::string&, int port, const std::string&) throw();
+	// stops keeping up the link to host and port, and closes it if it's
+	// open; false if there's none
+	bool closeInterConnection(const std::string&, int port) throw();
+	// a link to another worker over fd, see Supervisor; first if we start it
+	void openWorkerLink(int fd, bool first) throw();
+
+	// from InterHub, about its link
+	void linkUp(InterLink* l) throw();
+	void linkDown(InterLink* l, const std::string& why) throw();
+	// a line for each link
+	std::string getLinkStatus() const throw();
+
+	virtual void onTimer(int) throw();
 
 	void acceptLeaf(int fd, Socket::Domain d);
 	void acceptInterHub(int fd, Socket::Domain d);
@@ -28,6 +50,15 @@ private:
 
 	SockList listenSocks;
 
+	typedef std::vector<InterLink*> Links;
+	Links links;
+	int retryMin, retryMax;	// seconds
+	int maxLinking;
+	bool ticking;
+
+	// starts the links that are due, as far as maxLinking lets us
+	void superviseLinks() throw();
+
 	ConnectionManager() throw();
 	~ConnectionManager() throw() {}
 };
@@ -0,0 +1,30 @@
+// vim:ts=4:sw=4:noet
+#include "DeferredBuffer.h"
+
+#include "Socket.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace qhub;
+
+void DeferredBuffer::fill(vector<uint8_t>& v) throw()
+{
+	swap(v);
+	filled = true;
+	vector<Socket*> tmp;
+	tmp.swap(waiting);
+	for(vector<Socket*>::iterator i = tmp.begin(); i != tmp.end(); ++i)
+		(*i)->wake();
+}
+
+void DeferredBuffer::wait(Socket* s) const throw()
+{
+	if(find(waiting.begin(), waiting.end(), s) == waiting.end())
+		waiting.push_back(s);
+}
+
+void DeferredBuffer::forget(Socket* s) const throw()
+{
+	waiting.erase(remove(waiting.begin(), waiting.end(), s), waiting.end());
+}
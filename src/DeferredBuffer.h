@@ -0,0 +1,41 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_DEFERREDBUFFER_H
+#define QHUB_DEFERREDBUFFER_H
+
+#include "qhub.h"
+#include "Buffer.h"
+
+#include <vector>
+
+namespace qhub {
+
+/*
+ * A Buffer whose contents are still being made (by a Job, usually).  It can
+ * be queued on sockets like any other; a socket that gets to it before it
+ * is filled waits, and is woken up by fill().  Everything queued behind it
+ * waits too, so ordering on each connection is kept.
+ */
+class DeferredBuffer : public Buffer {
+public:
+	DeferredBuffer() throw() : filled(false) {}
+	virtual ~DeferredBuffer() throw() {}
+
+	virtual bool ready() const { return filled; }
+	virtual bool deferred() const { return true; }
+
+	// event loop only; takes the contents of v
+	void fill(std::vector<uint8_t>& v) throw();
+
+	// for Socket: s is stuck until we're filled, or doesn't care any more
+	void wait(Socket* s) const throw();
+	void forget(Socket* s) const throw();
+
+	typedef boost::shared_ptr<DeferredBuffer> MutablePtr;
+private:
+	bool filled;
+	mutable std::vector<Socket*> waiting;
+};
+
+} // namespace qhub
+
+#endif // QHUB_DEFERREDBUFFER_H
@@ -0,0 +1,66 @@
+// vim:ts=4:sw=4:noet
+#include "Deflater.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace qhub;
+
+Deflater::Deflater(int level, bool raw) throw(runtime_error)
+		: dict(NULL)
+{
+	zs.zalloc = NULL;
+	zs.zfree = NULL;
+	zs.opaque = NULL;
+	if(deflateInit2(&zs, level, Z_DEFLATED, raw ? -MAX_WBITS : MAX_WBITS,
+			8, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw runtime_error("could not initialize zlib stream");
+}
+
+Deflater::~Deflater() throw()
+{
+	deflateEnd(&zs);
+}
+
+void Deflater::reset() throw()
+{
+	deflateReset(&zs);
+	if(dict)
+		deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(dict->data()), dict->size());
+}
+
+void Deflater::setLevel(int level) throw(runtime_error)
+{
+	if(deflateParams(&zs, level, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw runtime_error("could not change compression level");
+}
+
+void Deflater::setDictionary(const string& d) throw(runtime_error)
+{
+	if(deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(d.data()), d.size()) != Z_OK)
+		throw runtime_error("could not set zlib dictionary");
+	dict = &d;
+}
+
+void Deflater::write(const void* p, size_t len, vector<uint8_t>& out, int flush) throw(runtime_error)
+{
+	// zlib doesn't touch the input, it's just not declared const everywhere
+	zs.next_in = static_cast<Bytef*>(const_cast<void*>(p));
+	zs.avail_in = len;
+
+	int ret;
+	do {
+		// deflate directly into the spare end of the output vector
+		vector<uint8_t>::size_type used = out.size();
+		uInt room = max<uInt>(deflateBound(&zs, zs.avail_in) / 2, 256);
+		out.resize(used + room);
+		zs.next_out = &out[used];
+		zs.avail_out = room;
+		ret = deflate(&zs, flush);
+		out.resize(used + room - zs.avail_out);
+		if(ret == Z_STREAM_ERROR)
+			throw runtime_error("compression failure");
+	} while(zs.avail_in || zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+	zs.next_in = NULL;
+}
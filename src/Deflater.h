@@ -0,0 +1,51 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_DEFLATER_H
+#define QHUB_DEFLATER_H
+
+#include "qhub.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <zlib.h>
+
+namespace qhub {
+
+/*
+ * A zlib deflate stream that outlives a single write.  Output is appended
+ * straight onto the caller's vector, so a caller that keeps its vector
+ * around between calls doesn't allocate in the steady state.
+ */
+class Deflater : boost::noncopyable {
+public:
+	// raw streams have no zlib header or trailer, so their sync-flushed
+	// output can be spliced into another stream
+	explicit Deflater(int level = Z_BEST_COMPRESSION, bool raw = false) throw(std::runtime_error);
+	~Deflater() throw();
+
+	// forget all history; the next output references nothing before it
+	// but the dictionary, if there is one
+	void reset() throw();
+	// takes effect from the next write on; not on a finished stream, which
+	// has to be reset first
+	void setLevel(int level) throw(std::runtime_error);
+	// only before the first write; d must outlive us
+	void setDictionary(const std::string& d) throw(std::runtime_error);
+
+	// flush is one of Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FULL_FLUSH or Z_FINISH
+	void write(const void* p, size_t len, std::vector<uint8_t>& out,
+			int flush = Z_NO_FLUSH) throw(std::runtime_error);
+	void flush(std::vector<uint8_t>& out, int flush = Z_SYNC_FLUSH) throw(std::runtime_error)
+			{ write(NULL, 0, out, flush); }
+
+private:
+	z_stream zs;
+	const std::string* dict;
+};
+
+} // namespace qhub
+
+#endif // QHUB_DEFLATER_H
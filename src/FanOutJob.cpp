@@ -0,0 +1,27 @@
+// vim:ts=4:sw=4:noet
+#include "FanOutJob.h"
+
+#include "ADCSocket.h"
+#include "HashBloom.h"
+
+using namespace std;
+using namespace qhub;
+
+FanOutJob::FanOutJob(const LocalUsers& u, LocalUsers::size_type f,
+		LocalUsers::size_type l, int n, const Buffer& p, const Buffer* zb,
+		const uint8_t* t, vector<int>& s) throw()
+		: users(u), first(f), last(l), need(n), plain(p), z(zb), tth(t), sent(s)
+{
+}
+
+void FanOutJob::run() throw()
+{
+	for(LocalUsers::size_type i = first; i < last; ++i) {
+		if((users.getFlags(i) & need) != need)
+			continue;
+		if(tth && users.getBloom(i) && !users.getBloom(i)->match(tth))
+			continue;
+		const Buffer& b = z && (users.getFlags(i) & LocalUsers::ZLIF) ? *z : plain;
+		sent[i] = users.getSocket(i)->trySend(b);
+	}
+}
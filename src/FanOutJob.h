@@ -0,0 +1,44 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_FANOUTJOB_H
+#define QHUB_FANOUTJOB_H
+
+#include "qhub.h"
+#include "Buffer.h"
+#include "LocalUsers.h"
+#include "WorkerPool.h"
+
+#include <vector>
+
+namespace qhub {
+
+/*
+ * Writes a broadcast straight to the sockets of local users first to last-1
+ * that have all the LocalUsers::Flags in need (and, with a tth, a bloom
+ * filter that may have it), for WorkerPool::runAll.
+ * ZLIF users get z if there is one, everybody else plain.  What each socket
+ * took goes in sent (see Socket::trySend); the event loop queues whatever's
+ * left afterwards.
+ */
+class FanOutJob : public Job {
+public:
+	FanOutJob(const LocalUsers& users, LocalUsers::size_type first,
+			LocalUsers::size_type last, int need, const Buffer& plain,
+			const Buffer* z, const uint8_t* tth, std::vector<int>& sent) throw();
+	virtual ~FanOutJob() throw() {}
+
+	virtual void run() throw();
+	virtual void done() throw() {}
+
+private:
+	const LocalUsers& users;
+	LocalUsers::size_type first, last;
+	int need;
+	const Buffer& plain;
+	const Buffer* z;
+	const uint8_t* tth;
+	std::vector<int>& sent;
+};
+
+} // namespace qhub
+
+#endif // QHUB_FANOUTJOB_H
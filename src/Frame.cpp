@@ -0,0 +1,150 @@
+// vim:ts=4:sw=4:noet
+#include "Frame.h"
+
+#include "ADC.h"
+#include "Command.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+using namespace qhub;
+
+namespace {
+
+// the command byte is the place here, counting from 1; 0 is followed by
+// the three letters of one that isn't.  Only ever add to the end.
+const Command::CmdInt codes[] = {
+	Command::CTM, Command::DSC, Command::GET, Command::GFI, Command::GPA,
+	Command::INF, Command::MSG, Command::PAS, Command::QUI, Command::RCM,
+	Command::RES, Command::SCH, Command::SID, Command::SND, Command::STA,
+	Command::SUP, Command::ZON, Command::ZOF, Command::CMD, Command::BLO,
+	Command::HAS, Command::VER, Command::FRM
+};
+const size_t numCodes = sizeof(codes) / sizeof(codes[0]);
+
+void putVarint(vector<uint8_t>& out, uint32_t v) throw()
+{
+	// 7 bits at a time, lowest first; the top bit says more follow
+	while(v >= 0x80) {
+		out.push_back(uint8_t(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back(uint8_t(v));
+}
+
+// false if [p, last) ends before the varint does
+bool getVarint(const char*& p, const char* last, uint32_t& v) throw(parse_error)
+{
+	v = 0;
+	for(int shift = 0; p != last; shift += 7) {
+		if(shift > 28)
+			throw parse_error("varint too long");
+		uint8_t c = *p++;
+		v |= uint32_t(c & 0x7F) << shift;
+		if(!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+int numSids(char action) throw()
+{
+	switch(action) {
+	case 'D':
+	case 'E':
+		return 2;
+	case 'B':
+	case 'F':
+	case 'S':
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+} // anonymous namespace
+
+Buffer::Ptr Frame::make(const Command& cmd) throw()
+{
+	vector<uint8_t> body;
+	body.push_back(cmd.getAction());
+	const Command::CmdInt* c = find(codes, codes + numCodes, cmd.getCmd());
+	if(c != codes + numCodes) {
+		body.push_back(uint8_t(c - codes + 1));
+	} else {
+		body.push_back(0);
+		body.push_back(uint8_t(cmd.getCmd() >> 8));
+		body.push_back(uint8_t(cmd.getCmd() >> 16));
+		body.push_back(uint8_t(cmd.getCmd() >> 24));
+	}
+	// how much of the line that stands for, "BINF AAAB" and the like
+	size_t head = 4;
+	int sids = numSids(cmd.getAction());
+	if(sids > 0) {
+		putVarint(body, cmd.getSource());
+		head += 5;
+	}
+	if(sids > 1) {
+		putVarint(body, cmd.getDest());
+		head += 5;
+	}
+	// the rest goes as it is, less the space before it and the newline
+	const string& line = cmd.toString();
+	if(line.size() > head + 1)
+		body.insert(body.end(), line.begin() + head + 1, line.end() - 1);
+
+	vector<uint8_t> tmp;
+	tmp.reserve(body.size() + 2);
+	putVarint(tmp, body.size());
+	tmp.insert(tmp.end(), body.begin(), body.end());
+	Buffer::MutablePtr b(new Buffer);
+	b->swap(tmp);
+	return b;
+}
+
+size_t Frame::size(const char* first, const char* last) throw(parse_error)
+{
+	const char* p = first;
+	uint32_t len;
+	if(!getVarint(p, last, len))
+		return 0;
+	if(len < 2 || size_t(p - first) + len > MAX_SIZE)
+		throw parse_error("bad frame length");
+	if(size_t(last - p) < len)
+		return 0;
+	return (p - first) + len;
+}
+
+void Frame::toLine(const char* first, const char* last, string& line) throw(parse_error)
+{
+	uint32_t v;
+	getVarint(first, last, v);
+	line.assign(1, *first++);
+	uint8_t c = *first++;
+	if(c == 0) {
+		if(last - first < 3)
+			throw parse_error("frame too short");
+		line.append(first, 3);
+		first += 3;
+	} else if(c <= numCodes) {
+		line += char(codes[c - 1] >> 8);
+		line += char(codes[c - 1] >> 16);
+		line += char(codes[c - 1] >> 24);
+	} else {
+		throw parse_error("unknown frame command");
+	}
+	for(int sids = numSids(line[0]); sids > 0; --sids) {
+		if(!getVarint(first, last, v) || v > 0xFFFFF)
+			throw parse_error("bad frame SID");
+		line += ' ';
+		line += ADC::fromSid(v);
+	}
+	if(first == last)
+		return;
+	// a line is one line
+	if(find(first, last, '\n') != last)
+		throw parse_error("newline in frame");
+	line += ' ';
+	line.append(first, last);
+}
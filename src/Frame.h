@@ -0,0 +1,35 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_FRAME_H
+#define QHUB_FRAME_H
+
+#include "qhub.h"
+#include "error.h"
+#include "Buffer.h"
+
+#include <string>
+
+namespace qhub {
+
+/*
+ * Binary framing of interhub links (ADFRAM): a command goes as a frame of
+ * its length, type, a byte for the command and the SIDs as varints.  What
+ * follows the SIDs on its line goes as it is, so what users send passes
+ * through untouched.
+ */
+class Frame {
+public:
+	// longest frame, length included; no longer than a line can be
+	static const size_t MAX_SIZE = 1024;
+
+	// cmd as a frame
+	static Buffer::Ptr make(const Command& cmd) throw();
+	// the size of the frame starting at first, or 0 if [first, last)
+	// doesn't have all of it yet
+	static size_t size(const char* first, const char* last) throw(parse_error);
+	// the line (less its newline) in the frame [first, last)
+	static void toLine(const char* first, const char* last, std::string& line) throw(parse_error);
+};
+
+} // namespace qhub
+
+#endif // QHUB_FRAME_H
@@ -0,0 +1,71 @@
+// vim:ts=4:sw=4:noet
+#include "HashBloom.h"
+
+#include "Command.h"
+#include "Encoder.h"
+#include "TigerHash.h"
+
+#include <cassert>
+
+using namespace std;
+using namespace qhub;
+
+const size_t HashBloom::K;
+const size_t HashBloom::H;
+
+size_t HashBloom::bitsFor(size_t files, size_t max) throw()
+{
+	// K bits a file at a fill of about half: files * K / ln 2
+	size_t want = files * K * 3 / 2;
+	size_t m = 1024;
+	while(m < want && m < max && m < (size_t(1) << H))
+		m <<= 1;
+	return m;
+}
+
+bool HashBloom::searchedTth(const Command& cmd, uint8_t* tth) throw()
+{
+	if(cmd.getCmd() != Command::SCH)
+		return false;
+	Command::ConstParamIter tr = cmd.find("TR");
+	// TR and 39 base32 characters
+	if(tr == cmd.end() || tr->size() != 2 + 39)
+		return false;
+	Encoder::fromBase32(tr->c_str() + 2, tth, TigerHash::HASH_SIZE);
+	return true;
+}
+
+bool HashBloom::match(const uint8_t* tth) const throw()
+{
+	if(data.empty())
+		return true;
+	size_t mask = getBits() - 1;
+	for(size_t n = 0; n < K; ++n) {
+		// the n'th H bits of the TTH, least significant first
+		size_t x = 0;
+		for(size_t i = 0; i < H; ++i) {
+			size_t bit = n * H + i;
+			if(tth[bit / 8] & (1 << (bit % 8)))
+				x |= size_t(1) << i;
+		}
+		x &= mask;
+		if(!(data[x / 8] & (1 << (x % 8))))
+			return false;
+	}
+	return true;
+}
+
+void HashBloom::foldInto(HashBloom& agg) const throw()
+{
+	assert(!agg.empty());
+	vector<uint8_t>& to = agg.data;
+	if(data.size() >= to.size()) {
+		// bit i lands on i modulo the smaller size
+		for(size_t i = 0; i < data.size(); ++i)
+			to[i % to.size()] |= data[i];
+	} else {
+		// and i here could be any of i, i + our size, ... there
+		for(size_t i = 0; i < to.size(); ++i)
+			to[i] |= data[i % data.size()];
+	}
+}
@@ -0,0 +1,51 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_HASHBLOOM_H
+#define QHUB_HASHBLOOM_H
+
+#include "qhub.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace qhub {
+
+/*
+ * Bloom filter of TTHs, as in the ADC BLOM extension: each of K hashes is
+ * the next H bits of the TTH, modulo the size.  We only ever ask for sizes
+ * that are powers of two, so filters of different sizes can be folded into
+ * each other (see foldInto) to sum up a whole hub.
+ */
+class HashBloom {
+public:
+	static const size_t K = 8;
+	static const size_t H = 24;
+
+	// the size (in bits) to ask of someone sharing that many files, at
+	// most max (a power of two)
+	static size_t bitsFor(size_t files, size_t max = size_t(1) << H) throw();
+	// the TTH cmd searches for (TigerHash::HASH_SIZE bytes); false if it
+	// isn't a TTH search
+	static bool searchedTth(const Command& cmd, uint8_t* tth) throw();
+
+	bool empty() const throw() { return data.empty(); }
+	size_t getBits() const throw() { return data.size() * 8; }
+	const std::vector<uint8_t>& getData() const throw() { return data; }
+
+	// takes the contents; its size must be a power of two
+	void swap(std::vector<uint8_t>& bits) throw() { data.swap(bits); }
+	void clear() throw() { data.clear(); }
+	// no TTHs at all, in a filter that many bits big (a power of two)
+	void reset(size_t bits) throw() { data.assign(bits / 8, 0); }
+	// an empty filter has everything
+	bool match(const uint8_t* tth) const throw();
+	// sets the bits in agg any TTH we match would be looked up at; agg
+	// must not be empty
+	void foldInto(HashBloom& agg) const throw();
+
+private:
+	std::vector<uint8_t> data;
+};
+
+} // namespace qhub
+
+#endif // QHUB_HASHBLOOM_H
@@ -7,6 +7,7 @@
 #include "Logs.h"
 #include "ServerManager.h"
 #include "Settings.h"
+#include "Supervisor.h"
 #include "XmlTok.h"
 
 using namespace qhub;
@@ -19,6 +20,12 @@ Hub::Hub() throw()
 	Logs::stat << "Name: " << getName() << endl;
 	sid = Util::toInt(p->getAttr("sid"));
 	assert(sid == (sid & ServerManager::instance()->getHubSidMask()));
+	// workers take the SIDs after ours, one hub's worth each
+	sid += Supervisor::instance()->getIndex() * (ServerManager::instance()->getClientSidMask() + 1);
+	if(sid >> 20) {
+		Logs::err << "no hub SID left for worker " << Supervisor::instance()->getIndex() << ": FATAL" << endl;
+		exit(EXIT_FAILURE);
+	}
 	Logs::stat << "SID: " << ADC::fromSid(sid) << endl;
 	setDescription(p->getAttr("description"));
 	setInterPass(p->getAttr("interpass"));
@@ -0,0 +1,60 @@
+// vim:ts=4:sw=4:noet
+#include "Inflater.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace qhub;
+
+Inflater::Inflater(const string* d) throw(runtime_error)
+		: dict(d), done(false)
+{
+	zs.zalloc = NULL;
+	zs.zfree = NULL;
+	zs.opaque = NULL;
+	zs.next_in = NULL;
+	zs.avail_in = 0;
+	if(inflateInit(&zs) != Z_OK)
+		throw runtime_error("could not initialize zlib stream");
+}
+
+Inflater::~Inflater() throw()
+{
+	inflateEnd(&zs);
+}
+
+size_t Inflater::read(const void* p, size_t len, vector<uint8_t>& out) throw(runtime_error)
+{
+	if(done)
+		return 0;
+	zs.next_in = static_cast<Bytef*>(const_cast<void*>(p));
+	zs.avail_in = len;
+
+	do {
+		vector<uint8_t>::size_type used = out.size();
+		uInt room = max<uInt>(zs.avail_in * 4, 1024);
+		out.resize(used + room);
+		zs.next_out = &out[used];
+		zs.avail_out = room;
+		int ret = inflate(&zs, Z_SYNC_FLUSH);
+		if(ret == Z_NEED_DICT) {
+			// zlib checks the dictionary's adler32 against the stream's for us
+			if(!dict || inflateSetDictionary(&zs,
+					reinterpret_cast<const Bytef*>(dict->data()), dict->size()) != Z_OK)
+				throw runtime_error("zlib stream needs a dictionary we don't have");
+			ret = inflate(&zs, Z_SYNC_FLUSH);
+		}
+		out.resize(used + room - zs.avail_out);
+		if(ret == Z_STREAM_END)
+			done = true;
+		else if(ret == Z_BUF_ERROR)
+			break; // needs more input
+		else if(ret != Z_OK)
+			throw runtime_error(zs.msg ? zs.msg : "decompression failure");
+	} while(!done && (zs.avail_in || zs.avail_out == 0));
+
+	size_t n = len - zs.avail_in;
+	zs.next_in = NULL;
+	zs.avail_in = 0;
+	return n;
+}
@@ -0,0 +1,40 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_INFLATER_H
+#define QHUB_INFLATER_H
+
+#include "qhub.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <zlib.h>
+
+namespace qhub {
+
+/*
+ * The receiving end of a ZLIF stream.  Input is fed in as it arrives off
+ * the socket; whatever follows the end of the zlib stream is left alone
+ * for the caller, since it's plain ADC again.
+ */
+class Inflater : boost::noncopyable {
+public:
+	// dict is offered if the stream asks for a dictionary; must outlive us
+	explicit Inflater(const std::string* dict = NULL) throw(std::runtime_error);
+	~Inflater() throw();
+
+	// appends to out; returns how much of p was used
+	size_t read(const void* p, size_t len, std::vector<uint8_t>& out) throw(std::runtime_error);
+	bool finished() const throw() { return done; }
+
+private:
+	z_stream zs;
+	const std::string* dict;
+	bool done;
+};
+
+} // namespace qhub
+
+#endif // QHUB_INFLATER_H
@@ -1,57 +1,148 @@
 // vim:ts=4:sw=4:noet
 #include "InterHub.h"
 
+#include "BloomManager.h"
 #include "ClientManager.h"
+#include "CompressionManager.h"
+#include "ConnectionManager.h"
 #include "Encoder.h"
 #include "EventManager.h"
+#include "Frame.h"
 #include "Hub.h"
+#include "InterLink.h"
 #include "Logs.h"
 #include "Plugin.h"
 #include "PluginManager.h"
 #include "ServerManager.h"
+#include "SyncLog.h"
 #include "TigerHash.h"
 #include "UserInfo.h"
 #include "Util.h"
+#include "ZDictionary.h"
+#include "ZStream.h"
+
+#include <climits>
+#include <cstdlib>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 
 using namespace std;
 using namespace qhub;
 
-InterHub::InterHub(const string& hn, short p, const string& pa) throw()
-		: hostname(hn), port(p), password(pa), outgoing(true)
+static uint64_t usecs()
 {
-	EventManager::instance()->addTimer(this); // callback for lookup after we exit ctor
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return uint64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+InterHub::InterHub(InterLink* l) throw()
+		: hostname(l->getHost()), port(l->getPort()), password(l->getPassword()),
+		outgoing(true), link(l), resolving(false), zdict(false), framed(false), bloomPos(0),
+		peer(INVALID_SID), syncVersion(0), listSent(false), versionSent(0), batchBytes(0),
+		flushTimer(false), congested(false), shed(0), dropping(false), pingSent(0), rtt(0),
+		avgRtt(0), jitter(0), pings(0), pingsLost(0), rttSaid(UINT_MAX), pinger(*this)
+{
+	EventManager::instance()->addTimer(this, TIMER_LOOKUP); // callback for lookup after we exit ctor
+}
+
+InterHub::InterHub(ADCSocket* s, const string& pass) throw()
+		: ConnectionBase(s), port(0), password(pass), outgoing(true), link(NULL), resolving(false),
+		zdict(false), framed(false), bloomPos(0), peer(INVALID_SID), syncVersion(0),
+		listSent(false), versionSent(0), batchBytes(0), flushTimer(false), congested(false),
+		shed(0), dropping(false), pingSent(0), rtt(0), avgRtt(0), jitter(0), pings(0),
+		pingsLost(0), rttSaid(UINT_MAX), pinger(*this)
+{
+	EventManager::instance()->addTimer(this, TIMER_START); // so plugins hear of us
 }
 
 InterHub::InterHub(ADCSocket* s) throw()
-		: ConnectionBase(s), outgoing(false)
+		: ConnectionBase(s), outgoing(false), link(NULL), resolving(false), zdict(false),
+		framed(false), bloomPos(0), peer(INVALID_SID), syncVersion(0), listSent(false),
+		versionSent(0), batchBytes(0), flushTimer(false), congested(false), shed(0),
+		dropping(false), pingSent(0), rtt(0), avgRtt(0), jitter(0), pings(0), pingsLost(0),
+		rttSaid(UINT_MAX), pinger(*this)
 {
 }
 
 void InterHub::onTimer(int what) throw()
 {
-	DnsManager::instance()->lookupName(hostname, this);
+	switch(what) {
+	case TIMER_START:
+		doSupports();
+		onConnected();
+		break;
+	case TIMER_FLUSH:
+		flushTimer = false;
+		if(congested && getSocket()->getQueued() >= ServerManager::instance()->getLinkQueue() / 2) {
+			// still catching up; look again later
+			int d = max(ServerManager::instance()->getLinkDelay(), 100);
+			EventManager::instance()->addTimer(this, TIMER_FLUSH, d / 1000, (d % 1000) * 1000);
+			flushTimer = true;
+			return;
+		}
+		congested = false;
+		flush();
+		break;
+	case TIMER_DROP:
+		{
+			// deletes us; the socket goes once we're out of here
+			ADCSocket* s = getSocket();
+			s->disconnect("link backlog over " + Util::toString(ServerManager::instance()->getLinkMax()) + " bytes");
+			EventManager::instance()->addTimer(s);
+		}
+		break;
+	default:
+		resolving = true;
+		DnsManager::instance()->lookupName(hostname, this);
+	}
 }
 
 // from DnsListener
 void InterHub::onResult(const string& name, const vector<in_addr>& addrs) throw()
 {
+	resolving = false;
+	if(!link) {
+		giveUp("link removed");
+		return;
+	}
 	const in_addr& ip = addrs[rand() % addrs.size()];
 	Logs::stat << "Connecting to hub at ip " << inet_ntoa(ip) << " and port " << getPort() << endl;
 	assert(getState() == PROTOCOL);
 
-	getSocket()->connect(inet_ntoa(ip), getPort());
+	try {
+		getSocket()->connect(inet_ntoa(ip), getPort());
+	} catch(const socket_error& e) {
+		giveUp(e.what());
+		return;
+	}
 	doSupports();
 	onConnected();
 }
 
 void InterHub::onFailure() throw()
 {
-	Logs::err << "Lookup of " << hostname << " failed, trying again in 5 minutes" << endl;
-	EventManager::instance()->addTimer(this, 0, 5*60);
+	resolving = false;
+	giveUp("lookup of " + hostname + " failed");
+}
+
+void InterHub::unlink() throw()
+{
+	link = NULL;
+	// otherwise the lookup would call back a deleted listener
+	if(!resolving)
+		giveUp("link removed");
+}
+
+void InterHub::giveUp(const string& why) throw()
+{
+	// deletes us, telling the link; the socket goes once we're out of here
+	ADCSocket* s = getSocket();
+	s->disconnect(why);
+	EventManager::instance()->addTimer(s);
 }
 
 // from ConnectionBase
@@ -67,7 +158,11 @@ void InterHub::onConnected() throw()
 // from ConnectionBase
 void InterHub::onDisconnected(const string& clue) throw()
 {
+	EventManager::instance()->removeTimer(this);
+	EventManager::instance()->removeTimer(&pinger);
 	ServerManager::instance()->deactivate(this);
+	if(link)
+		ConnectionManager::instance()->linkDown(link, clue);
 	Plugin::InterDisconnected action;
 	PluginManager::instance()->fire(action, this);
 	delete this;	// hope this doesn't cause segfaults :)
@@ -113,6 +208,14 @@ void InterHub::onLine(Command& cmd) throw(command_error)
 				|| find(cmd.begin(), cmd.end(), "ADIHUB") == cmd.end()) {
 			throw command_error("invalid supports");
 		}
+		updateSupports(cmd);
+		{
+			// same preset dictionary on both ends?
+			const Command& c = cmd;
+			Command::ConstParamIter i = c.find("ZD");
+			zdict = !ZDictionary::instance()->empty() && i != c.end()
+					&& i->substr(2) == ZDictionary::instance()->getId();
+		}
 		if(!outgoing) {
 			doSupports();
 			doAskPassword();
@@ -141,9 +244,16 @@ void InterHub::onLine(Command& cmd) throw(command_error)
 		}
 		break;
 	case INFLIST:
-		// TODO: some sort of compression of these large INF lists (ZLIF)
-		if(cmd != (Command::INF | 'B') && cmd != (Command::INF | 'S'))
+		if(cmd != (Command::INF | 'B') && cmd != (Command::INF | 'S')
+				&& cmd != (Command::QUI | 'I') && cmd != (Command::HAS | 'L')
+				&& cmd != (Command::VER | 'L')) {
 			state = NORMAL;
+			if(link)
+				ConnectionManager::instance()->linkUp(link);
+			if(hasSupport("PING") && ServerManager::instance()->getPingInterval() > 0)
+				EventManager::instance()->addTimer(&pinger, 0,
+						ServerManager::instance()->getPingInterval());
+		}
 	case NORMAL:
 		//pass the message on
 		handle(cmd);
@@ -155,23 +265,72 @@ void InterHub::onLine(Command& cmd) throw(command_error)
 
 void InterHub::doSupports() throw()
 {
-	send(Command('L', Command::SUP) << "ADBASE" << "ADIHUB");
+	Command cmd('L', Command::SUP);
+	cmd << "ADBASE" << "ADIHUB" << "ADZLIF" << "ADBLOM" << "ADSYNC" << "ADMESH" << "ADPING";
+	if(ServerManager::instance()->getLinkFrames())
+		cmd << "ADFRAM";
+	if(!ZDictionary::instance()->empty())
+		cmd << CmdParam("ZD", ZDictionary::instance()->getId());
+	send(cmd);
+}
+
+const string* InterHub::getZDictionary() const throw()
+{
+	return zdict ? &ZDictionary::instance()->get() : NULL;
 }
 
 void InterHub::doInf() throw()
 {
-	send(Command('S', Command::INF, Hub::instance()->getSid())
-			<< CmdParam("HU", "1")
-			<< CmdParam("NI", Hub::instance()->getName())
-			<< CmdParam("DE", Hub::instance()->getDescription())
-			<< CmdParam("VE", PACKAGE_NAME "/" PACKAGE_VERSION));
-	ServerManager::instance()->getInterList(this);
-	ClientManager::instance()->getUserList(this);
+	send(ServerManager::instance()->getInf());
+	// with SYNC or MESH, the rest waits for the other end to say what it has
+	if(!hasSupport("SYNC") && !hasSupport("MESH"))
+		doList(Util::emptyString, 0, false);
+}
+
+void InterHub::doList(const string& e, uint32_t v, bool known) throw()
+{
+	if(!known)
+		ServerManager::instance()->getInterList(this);
+	// users go even if it knows of us: those of ours that were on their way
+	// to it through other hubs when this link came up, it drops, as they
+	// now come the wrong way
+	SyncLog* sl = SyncLog::instance();
+	if(hasSupport("SYNC")) {
+		bool delta = sl->has(e, v);
+		// what follows takes it from v to now, or from nothing
+		send(Command('L', Command::VER) << sl->getEpoch()
+				<< Util::toString(delta ? v : 0) << Util::toString(sl->getVersion()));
+		versionSent = sl->getVersion();
+		// users of other hubs always go in full
+		ClientManager::instance()->getUserList(this, delta);
+		if(delta)
+			sl->sendSince(this, v);
+	} else {
+		ClientManager::instance()->getUserList(this);
+	}
+	listSent = true;
+	// everything after the list is held back until it's through, and then
+	// goes through one zlib stream for as long as the link lasts
+	if(hasSupport("ZLIF") && CompressionManager::instance()->compressLinks()) {
+		try {
+			getSocket()->setZStream(new ZStream(CompressionManager::instance()->getLevel()));
+		} catch(const runtime_error& e) {
+			Logs::err << "interhub link not compressed: " << e.what() << endl;
+		}
+	}
+	// so the other end knows the list is through
+	send(Command('L', Command::STA) << "000" << "INF list sent");
+	// and frames from here on, if we both take them
+	if(hasSupport("FRAM") && ServerManager::instance()->getLinkFrames()) {
+		flush();
+		send(Command('L', Command::FRM));
+		framed = true;
+	}
 }
 
 void InterHub::doAskPassword() throw()
 {
-	assert(state == IDENTIFY && salt.empty() && !outgoing);
+	assert(state == PROTOCOL && salt.empty() && !outgoing);
 	salt = Util::genRand(24);
 	send(Command('L', Command::GPA) << Encoder::toBase32(&salt.front(), salt.size()));
 }
@@ -192,18 +351,78 @@ void InterHub::doPassword(const Command& cmd) throw()
 
 void InterHub::handle(const Command& cmd) throw(command_error)
 {
-	if(cmd == (Command::INF | 'B')) {
-		ClientManager::instance()->addRemoteClient(cmd.getSource(), UserInfo(cmd));
+	if(cmd == (Command::BLO | 'L')) {
+		handleBloom(cmd);
+		return;
+	}
+	if(cmd == (Command::HAS | 'L')) {
+		handleHas(cmd);
+		return;
+	}
+	if(cmd == (Command::VER | 'L')) {
+		handleVersion(cmd);
+		return;
+	}
+	if(cmd == (Command::PIN | 'L')) {
+		// straight back, past anything batched
+		send(Command('L', Command::PON) << cmd[0]);
+		return;
+	}
+	if(cmd == (Command::PON | 'L')) {
+		handlePong(cmd);
+		return;
 	}
 	if(cmd == (Command::INF | 'S')) {
-		ServerManager::instance()->add(cmd.getSource(), UserInfo(cmd), this);
+		handleServerInfo(cmd);
+		return;
+	}
+	if(cmd == ('S' | Command::QUI)) {
+		if(ServerManager::instance()->quit(ADC::toSid(cmd[0]), this))
+			dispatch(cmd);
+		return;
+	}
+	if(cmd.getAction() != 'D' && cmd.getAction() != 'E'
+			&& !ServerManager::instance()->accepts(cmd, this))
+		return;	// a copy, or from a hub that's gone
+	if(cmd == (Command::INF | 'B')) {
+		ClientManager::instance()->addRemoteClient(cmd.getSource(), UserInfo(cmd));
 	}
 	if(cmd == ('I' | Command::QUI)) {
-		ClientManager::instance()->removeClient(ADC::toSid(cmd[0]));
+		sid_type sid = ADC::toSid(cmd[0]);
+		// a resync may repeat quits we've seen already
+		if(!ClientManager::instance()->hasClient(sid))
+			return;
+		ClientManager::instance()->removeClient(sid);
 	}
 	dispatch(cmd);
 }
 
+void InterHub::handleServerInfo(const Command& cmd) throw(command_error)
+{
+	if(peer != INVALID_SID) {
+		if(ServerManager::instance()->add(cmd.getSource(), UserInfo(cmd), this))
+			dispatch(cmd);
+		return;
+	}
+	// the first is the other end's own
+	peer = cmd.getSource();
+	bool known = ServerManager::instance()->hasServer(peer);
+	bool news = ServerManager::instance()->add(peer, UserInfo(cmd), this);
+	ServerManager::instance()->peered(this);
+	if(news)
+		dispatch(cmd);
+	// say what we have of it
+	if(hasSupport("SYNC") || hasSupport("MESH")) {
+		SyncLog::Kept* k = SyncLog::instance()->getKept(peer);
+		Command has('L', Command::HAS);
+		has << (k ? k->epoch : string("0")) << Util::toString(k ? k->version : 0);
+		// linked some other way already, so it needn't send the lot
+		if(known && hasSupport("MESH"))
+			has << CmdParam("KN", "1");
+		send(has);
+	}
+}
+
 void InterHub::handlePassword(const Command& cmd) throw(command_error)
 {
 	TigerHash h;
@@ -219,3 +438,247 @@ void InterHub::handlePassword(const Command& cmd) throw(command_error)
 	}
 	salt.clear();
 }
+
+void InterHub::sendBloom(const HashBloom& b) throw()
+{
+	// the other end starts out without one, so nothing to say either
+	if(b.getData() == bloomSent.getData())
+		return;
+	bloomSent = b;
+	if(b.empty()) {
+		send(Command('L', Command::BLO) << "0" << "0" << "");
+		return;
+	}
+	const vector<uint8_t>& d = b.getData();
+	const string& bits = Util::toString(b.getBits());
+	for(size_t off = 0; off < d.size(); off += 512) {
+		send(Command('L', Command::BLO) << bits << Util::toString(off)
+				<< Encoder::toBase32(&d[off], min(d.size() - off, size_t(512))));
+	}
+}
+
+void InterHub::handleBloom(const Command& cmd) throw(command_error)
+{
+	// LBLO <bits> <byte offset> <base32 bytes>; 0 bits is no filter
+	size_t bits = 0, off = 0;
+	try {
+		bits = Util::toInt(cmd[0]);
+		off = Util::toInt(cmd[1]);
+	} catch(const boost::bad_lexical_cast&) {
+		throw command_error("invalid BLO");
+	}
+	if(bits == 0) {
+		bloom.clear();
+		bloomIn.clear();
+		BloomManager::instance()->dropped(this);
+		return;
+	}
+	if(bits < 8 || bits > (size_t(1) << HashBloom::H) || (bits & (bits - 1)))
+		throw command_error("bad bloom filter size");
+	if(off == 0) {
+		bloomIn.assign(bits / 8, 0);
+		bloomPos = 0;
+	}
+	size_t len = cmd[2].size() * 5 / 8;
+	if(bloomIn.size() != bits / 8 || off != bloomPos || off + len > bloomIn.size())
+		throw command_error("bloom filter out of sequence");
+	Encoder::fromBase32(cmd[2].data(), &bloomIn[off], len);
+	bloomPos += len;
+	if(bloomPos == bloomIn.size()) {
+		bloom.swap(bloomIn);
+		bloomIn.clear();
+		BloomManager::instance()->changed();
+	}
+}
+
+void InterHub::handleHas(const Command& cmd) throw(command_error)
+{
+	// LHAS <epoch> <version> [KN1]: what the other end has of our users,
+	// and if it knows of us already, the other hubs
+	if(listSent || (!hasSupport("SYNC") && !hasSupport("MESH")))
+		throw command_error("unexpected HAS");
+	uint32_t v = 0;
+	try {
+		v = Util::toInt(cmd[1]);
+	} catch(const boost::bad_lexical_cast&) {
+		throw command_error("invalid HAS");
+	}
+	Command::ConstParamIter kn = cmd.find("KN");
+	doList(cmd[0], v, kn != cmd.end() && *kn == "KN1");
+}
+
+void InterHub::handleVersion(const Command& cmd) throw(command_error)
+{
+	// LVER <epoch> <base> <version>: after this we'll be in step with the
+	// other end's users as of version, if we were as of base (0 is none)
+	uint32_t base = 0, v = 0;
+	try {
+		base = Util::toInt(cmd[1]);
+		v = Util::toInt(cmd[2]);
+	} catch(const boost::bad_lexical_cast&) {
+		throw command_error("invalid VER");
+	}
+	if(state == INFLIST && peer != INVALID_SID) {
+		// the start of its list; a delta goes on top of what we kept
+		SyncLog::Kept* k = SyncLog::instance()->getKept(peer);
+		if(k && base && k->epoch == cmd[0] && k->version == base) {
+			for(vector<Command>::iterator i = k->infs.begin(); i != k->infs.end(); ++i) {
+				ClientManager::instance()->addRemoteClient(i->getSource(), UserInfo(*i));
+				dispatch(*i);
+			}
+		}
+		SyncLog::instance()->forget(peer);
+	}
+	syncEpoch = cmd[0];
+	syncVersion = v;
+}
+
+void InterHub::ping() throw()
+{
+	if(pingSent)
+		++pingsLost;
+	pingSent = usecs();
+	++pings;
+	send(Command('L', Command::PIN) << Util::toString(pingSent));
+	EventManager::instance()->addTimer(&pinger, 0, ServerManager::instance()->getPingInterval());
+}
+
+void InterHub::handlePong(const Command& cmd) throw(command_error)
+{
+	// LPON <token>: the token of our LPIN, which is when we sent it
+	uint64_t sent = strtoull(cmd[0].c_str(), NULL, 10);
+	if(!pingSent || sent != pingSent)
+		return;	// one we gave up on
+	pingSent = 0;
+	uint32_t r = min(usecs() - sent, uint64_t(UINT_MAX));
+	if(!avgRtt) {
+		avgRtt = r;
+	} else {
+		// as TCP and RTP do it
+		uint32_t d = r > rtt ? r - rtt : rtt - r;
+		jitter = d > jitter ? jitter + (d - jitter) / 16 : jitter - (jitter - d) / 16;
+		avgRtt = avgRtt - avgRtt / 8 + r / 8;
+	}
+	rtt = r;
+	// the rest of the network hears when it's changed by a fair bit
+	uint32_t ms = (avgRtt + 500) / 1000;
+	uint32_t d = ms > rttSaid ? ms - rttSaid : rttSaid - ms;
+	if(rttSaid == UINT_MAX || d >= max(2u, rttSaid / 4)) {
+		rttSaid = ms;
+		ServerManager::instance()->advertise();
+	}
+}
+
+void InterHub::sendVersion() throw()
+{
+	SyncLog* sl = SyncLog::instance();
+	if(!listSent || !hasSupport("SYNC") || versionSent == sl->getVersion())
+		return;
+	// the changes it's in step with go first
+	flush();
+	versionSent = sl->getVersion();
+	send(Command('L', Command::VER) << sl->getEpoch()
+			<< Util::toString(versionSent) << Util::toString(versionSent));
+}
+
+void InterHub::queue(const Command& cmd, const Buffer::Ptr& b, sid_type from, bool control) throw()
+{
+	if(dropping)
+		return;
+	ServerManager* sm = ServerManager::instance();
+	size_t backlog = getBacklog();
+	if(backlog >= sm->getLinkMax()) {
+		// it isn't keeping up at all; better it resyncs once it's back than
+		// we keep everything for it
+		dropping = true;
+		flushTimer = false;
+		EventManager::instance()->addTimer(this, TIMER_DROP);
+		return;
+	}
+	if(backlog >= sm->getLinkQueue())
+		congested = true;
+	else if(congested && batch.empty() && backlog < sm->getLinkQueue() / 2)
+		congested = false;
+
+	if(control) {
+		if(from == INVALID_SID || batchFrom.count(from))
+			flush();
+		getSocket()->writeb(b);
+		return;
+	}
+	if(congested) {
+		if(cmd.getCmd() == Command::SCH) {
+			++shed;
+			return;
+		}
+		if(cmd == (Command::INF | 'B')) {
+			BatchInfs::iterator i = batchInfs.find(from);
+			if(i != batchInfs.end()) {
+				// the other end hasn't had the one waiting, so one INF
+				// with both will do
+				Buffer::Ptr& old = batch[i->second.first];
+				i->second.second.merge(cmd);
+				batchBytes -= old->size();
+				old = pack(i->second.second);
+				batchBytes += old->size();
+				return;
+			}
+			batchInfs.insert(make_pair(from, make_pair(batch.size(), cmd)));
+		}
+	}
+	batch.push_back(b);
+	batchBytes += b->size();
+	batchFrom.insert(from);
+	int d = sm->getLinkDelay();
+	if(congested) {
+		// held until the socket drains; see onTimer
+		d = max(d, 100);
+		if(!flushTimer) {
+			EventManager::instance()->addTimer(this, TIMER_FLUSH, d / 1000, (d % 1000) * 1000);
+			flushTimer = true;
+		}
+	} else if(d <= 0 || batchBytes >= sm->getLinkBatch()) {
+		flush();
+	} else if(!flushTimer) {
+		EventManager::instance()->addTimer(this, TIMER_FLUSH, d / 1000, (d % 1000) * 1000);
+		flushTimer = true;
+	}
+}
+
+void InterHub::flush() throw()
+{
+	if(batch.empty() || dropping)
+		return;
+	// only ours; a start or drop waiting on the same listener stays
+	if(flushTimer) {
+		EventManager::instance()->removeTimer(this);
+		flushTimer = false;
+	}
+	if(batch.size() == 1) {
+		getSocket()->writeb(batch.front());
+	} else {
+		Buffer::MutablePtr tmp(new Buffer);
+		tmp->reserve(batchBytes);
+		for(vector<Buffer::Ptr>::iterator i = batch.begin(); i != batch.end(); ++i)
+			tmp->append(**i);
+		getSocket()->writeb(tmp);
+	}
+	batch.clear();
+	batchBytes = 0;
+	batchFrom.clear();
+	batchInfs.clear();
+}
+
+Buffer::Ptr InterHub::pack(const Command& cmd) const throw()
+{
+	return framed ? Frame::make(cmd) : Buffer::Ptr(new Buffer(cmd));
+}
+
+// from ConnectionBase
+void InterHub::send(const Command& cmd)
+{
+	if(framed)
+		getSocket()->writeb(Frame::make(cmd));
+	else
+		ConnectionBase::send(cmd);
+}
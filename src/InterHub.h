@@ -2,9 +2,14 @@
 #define QHUB_INTERHUB_H
 
 #include "qhub.h"
+#include "fast_map.h"
+#include "fast_set.h"
+#include "Buffer.h"
+#include "Command.h"
 #include "ConnectionBase.h"
 #include "DnsManager.h"
 #include "EventManager.h"
+#include "HashBloom.h"
 
 #include <string>
 #include <vector>
@@ -13,7 +18,10 @@ namespace qhub {
 
 class InterHub : public ConnectionBase, public EventListener, public DnsListener {
 public:
-	InterHub(const std::string& hn, short p, const std::string& pa) throw();
+	// outgoing, for l
+	explicit InterHub(InterLink* l) throw();
+	// outgoing, over s, which is connected already
+	InterHub(ADCSocket* s, const std::string& pass) throw();
 	InterHub(ADCSocket* s) throw();
 	virtual ~InterHub() throw() {};
 
@@ -26,10 +34,60 @@ public:
 	virtual void onFailure() throw();
 
 	short getPort() const { return port; }
+	// the InterLink we're for is gone: closes without telling it, once
+	// the lookup is back if one is out
+	void unlink() throw();
+
+	// TTHs to be found through the other end; empty if it hasn't said
+	const HashBloom& getBloom() const throw() { return bloom; }
+	// unless it's what it got last time
+	void sendBloom(const HashBloom&) throw();
+
+	// the hub at the other end; INVALID_SID until we have its SINF
+	sid_type getPeer() const throw() { return peer; }
+	// the version of the other end's users we're in step with, if it
+	// keeps a SyncLog; empty epoch if it doesn't or hasn't said
+	const std::string& getSyncEpoch() const throw() { return syncEpoch; }
+	uint32_t getSyncVersion() const throw() { return syncVersion; }
+	// tells the other end the version of our users it's in step with
+	void sendVersion() throw();
+
+	// broadcasts and directs to pass on: cmd, from (the user) from, as b.
+	// Control ones (QUI, SINF) go out at once, after anything of from's
+	// that's waiting, or everything if from is INVALID_SID; the rest wait
+	// for company, see ServerManager::getLinkDelay
+	void queue(const Command& cmd, const Buffer::Ptr& b, sid_type from, bool control) throw();
+	// sends what's waiting
+	void flush() throw();
+	// bytes on their way to the other end, batched or in the socket
+	size_t getBacklog() throw() { return batchBytes + getSocket()->getQueued(); }
+	// past ServerManager::getLinkQueue.  Until the socket is down to half
+	// that, searches for the other end are dropped, and the rest waits in
+	// the batch, where INFs of the same user are merged
+	bool isCongested() const throw() { return congested; }
+	// searches dropped so far
+	uint32_t getShed() const throw() { return shed; }
+	// round trips to the other end, in microseconds: the last one, a
+	// running average and how much one differs from the next (RFC 3550
+	// jitter); 0 until one's been timed.  Pings are sent every
+	// ServerManager::getPingInterval seconds, if the other end has PING
+	uint32_t getRtt() const throw() { return rtt; }
+	uint32_t getAvgRtt() const throw() { return avgRtt; }
+	uint32_t getJitter() const throw() { return jitter; }
+	uint32_t getPings() const throw() { return pings; }
+	// pings not answered before the next was due
+	uint32_t getPingsLost() const throw() { return pingsLost; }
+
+	// whether what we send goes in frames (see Frame), and cmd that way
+	// or as a line
+	bool isFramed() const throw() { return framed; }
+	Buffer::Ptr pack(const Command& cmd) const throw();
 
 	// from ConnectionBase
+	virtual void send(const Command& cmd);
 	virtual void doError(std::string const& msg, int code, std::string const& flag) throw();
 	virtual void doWarning(const std::string& msg) throw();
+	virtual const std::string* getZDictionary() const throw();
 
 protected:
 	/*
@@ -42,18 +100,88 @@ protected:
 private:
 	void doSupports() throw();
 	void doInf() throw();
+	// our users for the other end, which has them as of version v of our
+	// epoch e, if it has them at all; if it knows of us already, without
+	// the other hubs
+	void doList(const std::string& e, uint32_t v, bool known) throw();
 	void doAskPassword() throw();
 	void doPassword(const Command& cmd) throw();
+	// before we've got anywhere
+	void giveUp(const std::string& why) throw();
 
 	void handle(const Command& cmd) throw(command_error);
 	void handlePassword(const Command& cmd) throw(command_error);
+	void handleBloom(const Command& cmd) throw(command_error);
+	void handleHas(const Command& cmd) throw(command_error);
+	void handlePong(const Command& cmd) throw(command_error);
+	void handleServerInfo(const Command& cmd) throw(command_error);
+	void handleVersion(const Command& cmd) throw(command_error);
 
 	std::string hostname;
 	short port;
 	std::string password;
 	const bool outgoing;
+	// what we're connecting for, if outgoing; told when it's up and down
+	InterLink* link;
+	// a lookup of hostname is out, with us to call back
+	bool resolving;
+	// the other end has our preset dictionary
+	bool zdict;
+	// we've switched to frames
+	bool framed;
 
 	std::vector<uint8_t> salt;
+
+	HashBloom bloom;
+	// the one coming in, and how much of it has
+	std::vector<uint8_t> bloomIn;
+	size_t bloomPos;
+	HashBloom bloomSent;
+
+	sid_type peer;
+	std::string syncEpoch;
+	uint32_t syncVersion;
+	// our list is out, so versions may follow
+	bool listSent;
+	uint32_t versionSent;
+
+	// queue()d, to go out in one write
+	std::vector<Buffer::Ptr> batch;
+	size_t batchBytes;
+	// users with something in the batch
+	QHUB_FAST_SET<sid_type> batchFrom;
+	// a TIMER_FLUSH is waiting
+	bool flushTimer;
+	// while congested, where in the batch each user's INF is, and what
+	// it says
+	typedef QHUB_FAST_MAP<sid_type, std::pair<size_t, Command> > BatchInfs;
+	BatchInfs batchInfs;
+
+	bool congested;
+	uint32_t shed;
+	// past ServerManager::getLinkMax; on its way out
+	bool dropping;
+
+	// when the ping that's out went, in microseconds; 0 if none is
+	uint64_t pingSent;
+	uint32_t rtt, avgRtt, jitter;
+	uint32_t pings, pingsLost;
+	// the average round trip our SINF last gave, in milliseconds;
+	// UINT_MAX before the first
+	uint32_t rttSaid;
+	void ping() throw();
+
+	// EventManager keeps one timer per listener, so pings get their own
+	// rather than push out a flush or drop
+	class Pinger : public EventListener {
+	public:
+		explicit Pinger(InterHub& h) throw() : hub(h) {}
+		virtual void onTimer(int) throw() { hub.ping(); }
+	private:
+		InterHub& hub;
+	} pinger;
+
+	enum { TIMER_LOOKUP, TIMER_START, TIMER_FLUSH, TIMER_DROP };
 };
 
 } // namespace qhub
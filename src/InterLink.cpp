@@ -0,0 +1,71 @@
+// vim:ts=4:sw=4:noet
+#include "InterLink.h"
+
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+using namespace qhub;
+
+InterLink::InterLink(const string& h, short p, const string& pa) throw()
+		: host(h), port(p), password(pa), state(WAITING), next(0), hub(NULL), failures(0),
+		attempts(0), upSince(0)
+{
+}
+
+void InterLink::connecting(time_t now, InterHub* h) throw()
+{
+	state = CONNECTING;
+	next = now;
+	hub = h;
+	++attempts;
+}
+
+void InterLink::up(time_t now) throw()
+{
+	state = UP;
+	upSince = now;
+}
+
+void InterLink::down(time_t now, const string& why, int min, int max) throw()
+{
+	// a link that dropped right after coming up is as good as one that
+	// never did
+	if(state == UP && now - upSince >= max)
+		failures = 0;
+	state = WAITING;
+	hub = NULL;
+	lastError = why;
+
+	long d = min;
+	for(int i = 0; i < failures && d < max; ++i)
+		d *= 2;
+	if(d > max)
+		d = max;
+	++failures;
+	// somewhere in the second half
+	next = now + d / 2 + rand() % (d - d / 2 + 1);
+}
+
+string InterLink::getStatus(time_t now) const throw()
+{
+	ostringstream os;
+	os << host << ':' << port << ' ';
+	switch(state) {
+	case WAITING:
+		os << "down, next try in " << (next > now ? next - now : 0) << " s";
+		break;
+	case CONNECTING:
+		os << "connecting for " << now - next << " s";
+		break;
+	case UP:
+		os << "up for " << now - upSince << " s";
+		break;
+	}
+	os << ", " << attempts << " tries";
+	if(failures)
+		os << ", " << failures << " failed in a row";
+	if(!lastError.empty())
+		os << ", last error: " << lastError;
+	return os.str();
+}
@@ -0,0 +1,64 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_INTERLINK_H
+#define QHUB_INTERLINK_H
+
+#include "qhub.h"
+
+#include <ctime>
+#include <string>
+
+namespace qhub {
+
+/*
+ * An interhub connection we're supposed to keep up, and how that's been
+ * going.  ConnectionManager makes an outgoing InterHub for it whenever it's
+ * due, and the InterHub reports back.  After a failure the next try waits
+ * twice as long as the last, between min and max seconds, with jitter so
+ * links that failed together don't come back together.
+ */
+class InterLink {
+public:
+	enum State {
+		WAITING,	// for the next try
+		CONNECTING,	// up to the end of the INF lists
+		UP
+	};
+
+	InterLink(const std::string& h, short p, const std::string& pa) throw();
+
+	const std::string& getHost() const throw() { return host; }
+	short getPort() const throw() { return port; }
+	const std::string& getPassword() const throw() { return password; }
+	State getState() const throw() { return state; }
+	// when it's due, if WAITING; when the try started, if CONNECTING
+	time_t getNext() const throw() { return next; }
+	// the InterHub for it, while it's CONNECTING or UP
+	InterHub* getHub() const throw() { return hub; }
+
+	// h is the InterHub trying it
+	void connecting(time_t now, InterHub* h) throw();
+	void up(time_t now) throw();
+	// tries again after a backoff of min to max seconds
+	void down(time_t now, const std::string& why, int min, int max) throw();
+
+	// one line about it, for people
+	std::string getStatus(time_t now) const throw();
+
+private:
+	std::string host;
+	short port;
+	std::string password;
+
+	State state;
+	time_t next;
+	InterHub* hub;
+	// failures since it was last up for long enough
+	int failures;
+	unsigned attempts;
+	time_t upSince;
+	std::string lastError;
+};
+
+} // namespace qhub
+
+#endif // QHUB_INTERLINK_H
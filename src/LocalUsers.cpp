@@ -0,0 +1,115 @@
+// vim:ts=4:sw=4:noet
+#include "LocalUsers.h"
+
+#include "Client.h"
+#include "UserInfo.h"
+#include "Util.h"
+
+#include <cassert>
+
+using namespace std;
+using namespace qhub;
+
+LocalUsers::LocalUsers(sid_type m) throw()
+		: mask(m)
+{
+	// 0 means nobody, 1 is the hub bot
+	slots.resize(2);
+
+	static const char* const known[] = {
+		"TCP4", "TCP6", "UDP4", "UDP6", "ADC0", "ADCS", "NAT0", "SEGA", "ASCH", NULL
+	};
+	for(const char* const* f = known; *f; ++f)
+		featureBits[*f] = 1U << (f - known);
+}
+
+sid_type LocalUsers::alloc() throw()
+{
+	if(!freed.empty()) {
+		sid_type s = freed.front();
+		freed.pop_front();
+		return s;
+	}
+	if(slots.size() > mask)
+		return INVALID_SID;
+	slots.push_back(Slot());
+	return slots.size() - 1;
+}
+
+void LocalUsers::release(sid_type sid) throw()
+{
+	sid_type s = sid & mask;
+	assert(s >= 2 && s < slots.size() && !slots[s].client);
+	freed.push_back(s);
+}
+
+void LocalUsers::insert(Client* c) throw()
+{
+	Slot& s = slots[c->getSid() & mask];
+	assert(!s.client);
+	s.sid = c->getSid();
+	s.client = c;
+	s.pos = users.size();
+	users.push_back(c);
+	sockets.push_back(NULL);
+	features.push_back(0);
+	flags.push_back(0);
+	blooms.push_back(NULL);
+	hot(c, s.pos);
+}
+
+void LocalUsers::erase(sid_type sid) throw()
+{
+	Slot& s = slots[sid & mask];
+	assert(s.client);
+	// the last one takes its place
+	size_type last = users.size() - 1;
+	slots[users[last]->getSid() & mask].pos = s.pos;
+	users[s.pos] = users[last];
+	sockets[s.pos] = sockets[last];
+	features[s.pos] = features[last];
+	flags[s.pos] = flags[last];
+	blooms[s.pos] = blooms[last];
+	users.pop_back();
+	sockets.pop_back();
+	features.pop_back();
+	flags.pop_back();
+	blooms.pop_back();
+	s.sid = INVALID_SID;
+	s.client = NULL;
+}
+
+void LocalUsers::update(Client* c) throw()
+{
+	const Slot& s = slots[c->getSid() & mask];
+	if(s.client == c)
+		hot(c, s.pos);
+}
+
+uint32_t LocalUsers::getFeatureBit(const string& f) const throw()
+{
+	QHUB_FAST_MAP<string, uint32_t>::const_iterator i = featureBits.find(f);
+	return i != featureBits.end() ? i->second : 0;
+}
+
+void LocalUsers::hot(Client* c, size_type pos) throw()
+{
+	UserInfo* ui = c->getUserInfo();
+	uint32_t feat = 0;
+	int fl = 0;
+	const StringList& sl = Util::stringTokenize(ui->get("SU"), ',');
+	for(StringList::const_iterator i = sl.begin(); i != sl.end(); ++i) {
+		feat |= getFeatureBit(*i);
+		if(*i == "TCP4" || *i == "TCP6")
+			fl |= ACTIVE;
+	}
+	if(c->hasSupport("ZLIF"))
+		fl |= ZLIF;
+	if(ui->getOp())
+		fl |= OP;
+
+	sockets[pos] = c->getSocket();
+	features[pos] = feat;
+	flags[pos] = fl;
+	blooms[pos] = c->getBloom().empty() ? NULL : &c->getBloom();
+}
@@ -0,0 +1,103 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_LOCALUSERS_H
+#define QHUB_LOCALUSERS_H
+
+#include "qhub.h"
+#include "fast_map.h"
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace qhub {
+
+/*
+ * Hands out the client part of the SIDs of our own connections, and keeps
+ * the logged in ones.  A SID indexes an array of slots, so finding a
+ * client is one lookup; the clients themselves are also kept packed in a
+ * vector to walk for broadcasts.  Freed SIDs are handed out again oldest
+ * first, so one doesn't come back while others may still be talking about
+ * its last user.
+ *
+ * What a broadcast needs to know about each user (socket, INF SU features
+ * as a bitmask, a few flags, its TTH bloom filter) is kept in arrays of its
+ * own alongside, in the same order, so going through all of them doesn't
+ * touch the Client, its supports or its UserInfo.  Only the SU features
+ * the ADC specs define get a bit, so clients can't run out the bits with
+ * made up ones.
+ */
+class LocalUsers {
+public:
+	typedef std::vector<Client*>::const_iterator const_iterator;
+	typedef std::vector<Client*>::size_type size_type;
+
+	enum Flags {
+		ZLIF = 1,	// in HSUP
+		OP = 2,
+		ACTIVE = 4	// TCP4 or TCP6 in SU
+	};
+
+	// mask selects the client part of a SID
+	explicit LocalUsers(sid_type mask) throw();
+
+	// INVALID_SID if they're all taken
+	sid_type alloc() throw();
+	void release(sid_type sid) throw();
+
+	// c must have a SID from alloc() and not be in here already
+	void insert(Client* c) throw();
+	void erase(sid_type sid) throw();
+	// c's INF (or supports) changed
+	void update(Client* c) throw();
+	// NULL if there is no such user (any more)
+	Client* find(sid_type sid) const throw() {
+		sid_type s = sid & mask;
+		return s < slots.size() && slots[s].sid == sid ? slots[s].client : NULL;
+	}
+	bool count(sid_type sid) const throw() { return find(sid); }
+
+	const_iterator begin() const throw() { return users.begin(); }
+	const_iterator end() const throw() { return users.end(); }
+	size_type size() const throw() { return users.size(); }
+
+	// the i'th user's hot fields
+	Client* getClient(size_type i) const throw() { return users[i]; }
+	ADCSocket* getSocket(size_type i) const throw() { return sockets[i]; }
+	uint32_t getFeatures(size_type i) const throw() { return features[i]; }
+	int getFlags(size_type i) const throw() { return flags[i]; }
+	// NULL if there's none
+	const HashBloom* getBloom(size_type i) const throw() { return blooms[i]; }
+
+	// bit of SU feature f in getFeatures(); 0 if it isn't one that has one
+	uint32_t getFeatureBit(const std::string& f) const throw();
+
+private:
+	struct Slot {
+		Slot() throw() : sid(INVALID_SID), client(NULL), pos(0) {}
+		// all of it, so remote users with the same client part don't match
+		sid_type sid;
+		Client* client;
+		// where client is in users
+		std::vector<Client*>::size_type pos;
+	};
+
+	sid_type mask;
+	std::vector<Slot> slots;
+	std::deque<sid_type> freed;
+
+	// by position
+	std::vector<Client*> users;
+	std::vector<ADCSocket*> sockets;
+	std::vector<uint32_t> features;
+	std::vector<uint8_t> flags;
+	std::vector<const HashBloom*> blooms;
+
+	QHUB_FAST_MAP<std::string, uint32_t> featureBits;
+
+	void hot(Client* c, size_type pos) throw();
+};
+
+} // namespace qhub
+
+#endif // QHUB_LOCALUSERS_H
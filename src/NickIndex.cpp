@@ -0,0 +1,140 @@
+// vim:ts=4:sw=4:noet
+#include "NickIndex.h"
+
+using namespace std;
+using namespace qhub;
+
+namespace {
+
+// simple case folding of the scripts nicks are mostly in
+uint32_t foldChar(uint32_t c)
+{
+	if(c < 0x80)
+		return c >= 'A' && c <= 'Z' ? c + 32 : c;
+	if(c >= 0xC0 && c <= 0xDE && c != 0xD7)
+		return c + 32;
+	if(c >= 0x100 && c <= 0x17F) {
+		// Latin Extended-A: mostly upper then lower, but for a few
+		// stretches shifted by one
+		if(c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149)
+			return c;
+		if(c == 0x178)
+			return 0xFF;
+		if((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E))
+			return c & 1 ? c + 1 : c;
+		return c & 1 ? c : c + 1;
+	}
+	if(c >= 0x391 && c <= 0x3AB && c != 0x3A2)
+		return c + 32;
+	if(c == 0x3C2)	// final sigma
+		return 0x3C3;
+	if(c >= 0x400 && c <= 0x40F)
+		return c + 80;
+	if(c >= 0x410 && c <= 0x42F)
+		return c + 32;
+	if((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF))
+		return c & 1 ? c : c + 1;
+	if(c >= 0xFF21 && c <= 0xFF3A)
+		return c + 32;
+	return c;
+}
+
+void putChar(string& out, uint32_t c)
+{
+	if(c < 0x80) {
+		out += char(c);
+	} else if(c < 0x800) {
+		out += char(0xC0 | (c >> 6));
+		out += char(0x80 | (c & 0x3F));
+	} else if(c < 0x10000) {
+		out += char(0xE0 | (c >> 12));
+		out += char(0x80 | ((c >> 6) & 0x3F));
+		out += char(0x80 | (c & 0x3F));
+	} else {
+		out += char(0xF0 | (c >> 18));
+		out += char(0x80 | ((c >> 12) & 0x3F));
+		out += char(0x80 | ((c >> 6) & 0x3F));
+		out += char(0x80 | (c & 0x3F));
+	}
+}
+
+} // anonymous namespace
+
+string NickIndex::fold(const string& nick) throw()
+{
+	string out;
+	out.reserve(nick.size());
+	string::size_type i = 0, n = nick.size();
+	while(i < n) {
+		uint8_t b = nick[i];
+		string::size_type len;
+		uint32_t c;
+		if(b < 0x80) {
+			len = 1;
+			c = b;
+		} else if((b & 0xE0) == 0xC0) {
+			len = 2;
+			c = b & 0x1F;
+		} else if((b & 0xF0) == 0xE0) {
+			len = 3;
+			c = b & 0x0F;
+		} else if((b & 0xF8) == 0xF0) {
+			len = 4;
+			c = b & 0x07;
+		} else {
+			len = 0;
+			c = 0;
+		}
+		bool valid = len && i + len <= n;
+		for(string::size_type j = 1; valid && j < len; ++j) {
+			uint8_t cb = nick[i + j];
+			if((cb & 0xC0) != 0x80)
+				valid = false;
+			c = (c << 6) | (cb & 0x3F);
+		}
+		if(!valid) {
+			out += nick[i++];
+			continue;
+		}
+		putChar(out, foldChar(c));
+		i += len;
+	}
+	return out;
+}
+
+void NickIndex::insert(const string& nick, sid_type sid) throw()
+{
+	string f = fold(nick);
+	if(sorted.insert(make_pair(f, sid)).second)
+		++counts[f];
+}
+
+void NickIndex::erase(const string& nick, sid_type sid) throw()
+{
+	string f = fold(nick);
+	if(!sorted.erase(make_pair(f, sid)))
+		return;
+	QHUB_FAST_MAP<string, int>::iterator i = counts.find(f);
+	if(--i->second == 0)
+		counts.erase(i);
+}
+
+bool NickIndex::has(const string& nick, sid_type except) const throw()
+{
+	string f = fold(nick);
+	QHUB_FAST_MAP<string, int>::const_iterator i = counts.find(f);
+	if(i == counts.end())
+		return false;
+	return i->second > 1 || !sorted.count(make_pair(f, except));
+}
+
+void NickIndex::findPrefix(const string& prefix, vector<sid_type>& ret,
+		vector<sid_type>::size_type max) const throw()
+{
+	string f = fold(prefix);
+	vector<sid_type>::size_type found = 0;
+	for(Sorted::const_iterator i = sorted.lower_bound(make_pair(f, sid_type(0)));
+			i != sorted.end() && found < max && i->first.compare(0, f.size(), f) == 0;
+			++i, ++found)
+		ret.push_back(i->second);
+}
@@ -0,0 +1,47 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_NICKINDEX_H
+#define QHUB_NICKINDEX_H
+
+#include "qhub.h"
+#include "fast_map.h"
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace qhub {
+
+/*
+ * Everybody's nick, case folded (see fold()) so nicks that differ only in
+ * case collide, whatever the script.  Exact lookups are hashed; prefix
+ * lookups go through a sorted copy.  Nicks may be in there more than once:
+ * users on other hubs were let in by those, and we take what we're told.
+ */
+class NickIndex {
+public:
+	// nick in lower case, or as close to it as simple (one to one) case
+	// folding of Latin, Greek, Cyrillic and fullwidth Latin gets; bytes
+	// that aren't valid UTF-8 are left as they are
+	static std::string fold(const std::string& nick) throw();
+
+	void insert(const std::string& nick, sid_type sid) throw();
+	void erase(const std::string& nick, sid_type sid) throw();
+
+	// someone other than except has nick
+	bool has(const std::string& nick, sid_type except = INVALID_SID) const throw();
+	// appends the users whose nick starts with prefix, up to max of them,
+	// in folded nick order
+	void findPrefix(const std::string& prefix, std::vector<sid_type>& ret,
+			std::vector<sid_type>::size_type max = -1) const throw();
+
+private:
+	// users with each folded nick
+	QHUB_FAST_MAP<std::string, int> counts;
+	typedef std::set<std::pair<std::string, sid_type> > Sorted;
+	Sorted sorted;
+};
+
+} // namespace qhub
+
+#endif // QHUB_NICKINDEX_H
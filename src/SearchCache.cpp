@@ -0,0 +1,71 @@
+// vim:ts=4:sw=4:noet
+#include "SearchCache.h"
+
+#include "Command.h"
+#include "Logs.h"
+#include "Settings.h"
+#include "Util.h"
+#include "XmlTok.h"
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+using namespace std;
+using namespace qhub;
+
+SearchCache::SearchCache() throw()
+{
+	const string& w = Settings::instance()->getConfig("__hub")->getAttr("searchwindow");
+	window = 10;
+	try {
+		if(!w.empty())
+			window = Util::toInt(w);
+	} catch(const boost::bad_lexical_cast&) {
+		Logs::err << "bad searchwindow \"" << w << "\", using " << window << endl;
+	}
+}
+
+string SearchCache::key(const Command& cmd) throw()
+{
+	vector<string> terms;
+	for(Command::ConstParamIter i = cmd.begin() + cmd.getOffset(); i != cmd.end(); ++i) {
+		string t(*i);
+		// terms match regardless of case; the token has to be the same
+		if(t.size() > 2 && t.compare(0, 2, "TO") != 0)
+			transform(t.begin() + 2, t.end(), t.begin() + 2, ::tolower);
+		terms.push_back(t);
+	}
+	sort(terms.begin(), terms.end());
+
+	string k(1, cmd.getAction());
+	k += Util::toString(cmd.getSource());
+	k += ' ';
+	k += Util::toString(cmd.getDest());
+	k += ' ';
+	k += cmd.getFeatures();
+	for(vector<string>::const_iterator i = terms.begin(); i != terms.end(); ++i) {
+		k += ' ';
+		k += *i;
+	}
+	return k;
+}
+
+bool SearchCache::repeated(const Command& cmd) throw()
+{
+	if(window <= 0)
+		return false;
+
+	time_t now = time(NULL);
+	while(!expiry.empty() && expiry.front().first + window <= now) {
+		recent.erase(expiry.front().second);
+		expiry.pop_front();
+	}
+
+	string k = key(cmd);
+	if(recent.count(k))
+		return true;
+	recent.insert(k);
+	expiry.push_back(make_pair(now, k));
+	return false;
+}
@@ -0,0 +1,45 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_SEARCHCACHE_H
+#define QHUB_SEARCHCACHE_H
+
+#include "qhub.h"
+#include "fast_set.h"
+#include "Singleton.h"
+
+#include <ctime>
+#include <deque>
+#include <string>
+#include <utility>
+
+namespace qhub {
+
+/*
+ * Remembers recent searches for searchwindow seconds (<__hub>, 0 turns it
+ * off), so a user repeating one inside that time isn't broadcast again.
+ * Searches are compared with the terms in any order and case, but only
+ * with the same token: a new token means the client wants results again.
+ * Only the same user's searches count: anyone else searching for the same
+ * thing still needs their own results.
+ */
+class SearchCache : public Singleton<SearchCache> {
+public:
+	// true if cmd repeats a recent search; remembers it otherwise
+	bool repeated(const Command& cmd) throw();
+
+private:
+	friend class Singleton<SearchCache>;
+
+	time_t window;
+	QHUB_FAST_SET<std::string> recent;
+	// oldest first
+	std::deque<std::pair<time_t, std::string> > expiry;
+
+	static std::string key(const Command& cmd) throw();
+
+	SearchCache() throw();
+	~SearchCache() throw() {}
+};
+
+} // namespace qhub
+
+#endif // QHUB_SEARCHCACHE_H
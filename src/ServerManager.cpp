@@ -1,36 +1,111 @@
 // vim:ts=4:sw=4:noet
 #include "ServerManager.h"
 
+#include "ADC.h"
+#include "BloomManager.h"
+#include "ClientManager.h"
+#include "Command.h"
+#include "HashBloom.h"
+#include "Hub.h"
 #include "InterHub.h"
+#include "Logs.h"
 #include "Settings.h"
+#include "SyncLog.h"
+#include "TigerHash.h"
 #include "XmlTok.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <deque>
+#include <sstream>
+
 using namespace std;
 using namespace qhub;
 
-ServerManager::ServerManager() throw() : sidMask(0xFFFFFFFF)
+void RemoteHub::parse() throw()
+{
+	seq = strtoul(ui.get("SQ").c_str(), NULL, 10);
+	links.clear();
+	const StringList& l = Util::stringTokenize(ui.get("LK"), ',');
+	for(StringList::const_iterator i = l.begin(); i != l.end(); ++i) {
+		try {
+			links.insert(ADC::toSid(*i));
+		} catch(const parse_error&) {
+		}
+	}
+	// SID:milliseconds, for the links it's timed
+	rtts.clear();
+	const StringList& t = Util::stringTokenize(ui.get("LT"), ',');
+	for(StringList::const_iterator i = t.begin(); i != t.end(); ++i) {
+		string::size_type c = i->find(':');
+		if(c == string::npos)
+			continue;
+		try {
+			rtts[ADC::toSid(i->substr(0, c))] = atoi(i->c_str() + c + 1);
+		} catch(const parse_error&) {
+		}
+	}
+}
+
+int RemoteHub::getRtt(sid_type s) const throw()
+{
+	map<sid_type, int>::const_iterator i = rtts.find(s);
+	return i == rtts.end() ? -1 : i->second;
+}
+
+ServerManager::ServerManager() throw() : sidMask(0xFFFFFFFF), seq(time(NULL)), waiting(false)
 {
 	XmlTok* p = Settings::instance()->getConfig("__hub");
 	int i = Util::toInt(p->getAttr("hubsidbits"));
 	sidMask >>= 20 - i;
 	sidMask <<= 20 - i;
+	holdTime = Settings::getInt(p, "routehold", 5);
+	linkDelay = Settings::getInt(p, "linkdelay", 20);
+	linkBatch = Settings::getInt(p, "linkbatch", 16 * 1024);
+	linkQueue = Settings::getInt(p, "linkqueue", 256 * 1024);
+	linkMax = Settings::getInt(p, "linkmax", 16 * 1024 * 1024);
+	linkFrames = p->getAttr("linkframes") == "1";
+	pingInterval = Settings::getInt(p, "pinginterval", 10);
 }
 
 void ServerManager::getInterList(InterHub* ih) throw()
 {
+	// so each hub comes after one it's linked to
+	vector<pair<int, sid_type> > order;
 	for(RemoteHubs::iterator i = remoteHubs.begin(); i != remoteHubs.end(); ++i) {
-		ih->send(i->second->getUserInfo()->toADC(i->first));
+		// the peer has said hello by now; don't tell it about itself
+		if(i->first == ih->getPeer())
+			continue;
+		order.push_back(make_pair(i->second->getHops() ? i->second->getHops() : INT_MAX, i->first));
 	}
+	sort(order.begin(), order.end());
+	for(vector<pair<int, sid_type> >::iterator i = order.begin(); i != order.end(); ++i)
+		ih->send(remoteHubs[i->second]->getUserInfo()->toADC(i->second));
 }
 
-void ServerManager::add(sid_type sid, const UserInfo& ui, InterHub* conn) throw()
+bool ServerManager::add(sid_type sid, const UserInfo& ui, InterHub* conn) throw()
 {
-	if(remoteHubs.count(sid)) {
-		assert(conn == remoteHubs[sid]->getInterHub());
-		remoteHubs[sid]->getUserInfo()->update(ui);
-	} else {
+	if(sid == Hub::instance()->getSid())
+		return false;	// ours, come round again
+	RemoteHubs::iterator i = remoteHubs.find(sid);
+	if(i == remoteHubs.end()) {
 		remoteHubs.insert(make_pair(sid, new RemoteHub(ui, conn)));
+	} else {
+		RemoteHub* h = i->second;
+		if(h->isMesh()) {
+			// seen this one (or a later one) already
+			if(strtoul(ui.get("SQ").c_str(), NULL, 10) <= h->seq)
+				return false;
+		} else if(conn != h->getInterHub()) {
+			return false;
+		}
+		h->ui.update(ui);
+		h->parse();
+		h->via = conn;
 	}
+	route();
+	return true;
 }
 
 void ServerManager::remove(sid_type sid) throw()
@@ -42,16 +117,71 @@ void ServerManager::remove(sid_type sid) throw()
 	}
 }
 
+void ServerManager::split(sid_type sid) throw()
+{
+	ClientManager::instance()->netsplit(sid);
+	remove(sid);
+}
+
+bool ServerManager::quit(sid_type sid, InterHub* from) throw()
+{
+	RemoteHubs::iterator i = remoteHubs.find(sid);
+	if(i == remoteHubs.end() || i->second->getInterHub() != from)
+		return false;
+	// hubs on the map come and go by what their neighbours say about
+	// them, unless it's from one that doesn't draw the map
+	RemoteHubs::iterator p = remoteHubs.find(from->getPeer());
+	if(graph.count(sid) && p != remoteHubs.end() && p->second->isMesh())
+		return false;
+	split(sid);
+	route();
+	return true;
+}
+
 void ServerManager::activate(InterHub* ih) throw()
 {
 	interhubs.push_back(ih);
+	BloomManager::instance()->changed();
+}
+
+void ServerManager::peered(InterHub* ih) throw()
+{
+	advertise();
+	route();
 }
 
 void ServerManager::deactivate(InterHub* ih) throw()
 {
 	Interhubs::iterator i = find(interhubs.begin(), interhubs.end(), ih);
-	if(i != interhubs.end())
-		interhubs.erase(i);
+	if(i == interhubs.end())
+		return;
+	interhubs.erase(i);
+	BloomManager::instance()->changed();
+
+	sid_type peer = ih->getPeer();
+	vector<Command> infs;
+	if(peer != INVALID_SID && !ih->getSyncEpoch().empty()) {
+		// in case it's split off and comes back soon; see SyncLog
+		vector<sid_type> sids;
+		ClientManager::instance()->getAllInHub(peer, sids);
+		infs.reserve(sids.size());
+		for(vector<sid_type>::iterator j = sids.begin(); j != sids.end(); ++j)
+			infs.push_back(ClientManager::instance()->getUserInfo(*j)->toADC(*j));
+	}
+
+	for(RemoteHubs::iterator j = remoteHubs.begin(); j != remoteHubs.end(); ++j) {
+		if(j->second->via == ih)
+			j->second->via = NULL;
+		// route() sorts out the rest
+		if(j->second->next == ih)
+			j->second->next = NULL;
+	}
+	if(peer != INVALID_SID)
+		advertise();
+	route();
+
+	if(!infs.empty() && !remoteHubs.count(peer))
+		SyncLog::instance()->keep(peer, ih->getSyncEpoch(), ih->getSyncVersion(), infs);
 }
 
 bool ServerManager::hasServer(sid_type sid) const throw()
@@ -59,20 +189,448 @@ bool ServerManager::hasServer(sid_type sid) const throw()
 	return remoteHubs.count(sid);
 }
 
+Command ServerManager::getInf() const throw()
+{
+	string links, rtts;
+	for(Interhubs::const_iterator i = interhubs.begin(); i != interhubs.end(); ++i) {
+		if((*i)->getPeer() == INVALID_SID)
+			continue;
+		if(!links.empty())
+			links += ',';
+		links += ADC::fromSid((*i)->getPeer());
+		if(!(*i)->getAvgRtt())
+			continue;
+		if(!rtts.empty())
+			rtts += ',';
+		rtts += ADC::fromSid((*i)->getPeer()) + ':' + Util::toString(((*i)->getAvgRtt() + 500) / 1000);
+	}
+	return Command('S', Command::INF, Hub::instance()->getSid())
+			<< CmdParam("HU", "1")
+			<< CmdParam("NI", Hub::instance()->getName())
+			<< CmdParam("DE", Hub::instance()->getDescription())
+			<< CmdParam("VE", PACKAGE_NAME "/" PACKAGE_VERSION)
+			<< CmdParam("LK", links)
+			<< CmdParam("LT", rtts)
+			<< CmdParam("SQ", Util::toString(seq));
+}
+
+void ServerManager::advertise() throw()
+{
+	++seq;
+	const Command& inf = getInf();
+	Buffer::Ptr line, frame;
+	for(Interhubs::const_iterator i = interhubs.begin(); i != interhubs.end(); ++i) {
+		Buffer::Ptr& b = (*i)->isFramed() ? frame : line;
+		if(!b)
+			b = (*i)->pack(inf);
+		(*i)->getSocket()->writeb(b);
+	}
+}
+
+void ServerManager::route() throw()
+{
+	sid_type us = Hub::instance()->getSid();
+	vector<sid_type> gone;
+	do {
+		for(vector<sid_type>::iterator j = gone.begin(); j != gone.end(); ++j)
+			split(*j);
+		trees.clear();
+		graph.clear();
+
+		// our own links we know about; for the rest, a link counts if
+		// both ends say so, or the far end doesn't say what it's linked to
+		map<sid_type, InterHub*> peers;
+		for(Interhubs::iterator i = interhubs.begin(); i != interhubs.end(); ++i) {
+			sid_type p = (*i)->getPeer();
+			if(p == INVALID_SID || !remoteHubs.count(p) || peers.count(p))
+				continue;
+			peers[p] = *i;
+			graph[us].insert(p);
+			graph[p].insert(us);
+		}
+		for(RemoteHubs::iterator i = remoteHubs.begin(); i != remoteHubs.end(); ++i) {
+			const set<sid_type>& l = i->second->links;
+			for(set<sid_type>::const_iterator j = l.begin(); j != l.end(); ++j) {
+				RemoteHubs::iterator k = remoteHubs.find(*j);
+				if(k != remoteHubs.end()
+						&& (!k->second->isMesh() || k->second->linksTo(i->first))) {
+					graph[i->first].insert(*j);
+					graph[*j].insert(i->first);
+				}
+			}
+		}
+
+		// shortest ways out from here; of those, the one through the lowest SIDs
+		typedef map<sid_type, pair<sid_type, int> > Reached;	// first hop, hops
+		Reached reached;
+		deque<sid_type> q;
+		reached[us] = make_pair(us, 0);
+		q.push_back(us);
+		while(!q.empty()) {
+			Reached::mapped_type& u = reached[q.front()];
+			const set<sid_type>& n = graph[q.front()];
+			for(set<sid_type>::const_iterator j = n.begin(); j != n.end(); ++j) {
+				if(reached.count(*j))
+					continue;
+				reached[*j] = make_pair(u.second ? u.first : *j, u.second + 1);
+				q.push_back(*j);
+			}
+			q.pop_front();
+		}
+
+		time_t now = time(NULL);
+		gone.clear();
+		for(RemoteHubs::iterator i = remoteHubs.begin(); i != remoteHubs.end(); ++i) {
+			RemoteHub* h = i->second;
+			Reached::iterator r = reached.find(i->first);
+			if(r != reached.end()) {
+				h->next = peers[r->second.first];
+				h->hops = r->second.second;
+				h->lost = 0;
+				continue;
+			}
+			h->next = h->via;
+			h->hops = 0;
+			if(!h->via) {
+				gone.push_back(i->first);
+			} else if(h->isMesh() || graph.count(i->first)) {
+				// off the map, but the news that puts it back may be on its way
+				if(!h->lost)
+					h->lost = now;
+				if(now - h->lost >= holdTime) {
+					gone.push_back(i->first);
+				} else if(!waiting) {
+					waiting = true;
+					EventManager::instance()->addTimer(this, 0, 1);
+				}
+			}
+		}
+		for(vector<sid_type>::iterator j = gone.begin(); j != gone.end(); ++j) {
+			Logs::stat << "hub " << ADC::fromSid(*j) << " can't be reached any more" << endl;
+			broadcast(Command('S', Command::QUI, us) << ADC::fromSid(*j), NULL);
+		}
+	} while(!gone.empty());
+}
+
+void ServerManager::onTimer(int) throw()
+{
+	waiting = false;
+	route();
+}
+
+sid_type ServerManager::origin(const Command& cmd) const throw()
+{
+	switch(cmd.getAction()) {
+	case 'B':
+	case 'F':
+	case 'S':
+		return cmd.getSource() & sidMask;
+	case 'I':
+		// QUI is about its parameter, not the (hub) sending it
+		if(cmd.getCmd() == Command::QUI) {
+			try {
+				return ADC::toSid(cmd[0]) & sidMask;
+			} catch(const parse_error&) {
+			}
+		}
+		break;
+	}
+	return INVALID_SID;
+}
+
+const ServerManager::Tree& ServerManager::getTree(sid_type o) throw()
+{
+	Trees::iterator t = trees.find(o);
+	if(t != trees.end())
+		return t->second;
+	Tree& tree = trees[o];
+
+	// the shortest ways out from o, picked the same way every hub does
+	sid_type us = Hub::instance()->getSid();
+	map<sid_type, sid_type> parent;
+	if(graph.count(o)) {
+		deque<sid_type> q;
+		parent[o] = o;
+		q.push_back(o);
+		while(!q.empty()) {
+			const set<sid_type>& n = graph[q.front()];
+			for(set<sid_type>::const_iterator j = n.begin(); j != n.end(); ++j) {
+				if(parent.count(*j))
+					continue;
+				parent[*j] = q.front();
+				q.push_back(*j);
+			}
+			q.pop_front();
+		}
+	}
+
+	map<sid_type, sid_type>::iterator up = parent.find(us);
+	if(up == parent.end()) {
+		// not on the map with us; as in a tree, in on the link we heard
+		// of it through and out on all the others
+		RemoteHubs::iterator h = remoteHubs.find(o);
+		tree.from = h != remoteHubs.end() ? h->second->getInterHub() : NULL;
+		tree.to = interhubs;
+		return tree;
+	}
+	for(Interhubs::iterator i = interhubs.begin(); i != interhubs.end(); ++i) {
+		sid_type p = (*i)->getPeer();
+		if(p == up->second && !tree.from)
+			tree.from = *i;
+		map<sid_type, sid_type>::iterator j = parent.find(p);
+		// links still saying hello aren't on the map yet, but get it all
+		if(p == INVALID_SID || j == parent.end() || j->second == us)
+			tree.to.push_back(*i);
+	}
+	return tree;
+}
+
+bool ServerManager::accepts(const Command& cmd, InterHub* from) throw()
+{
+	sid_type o = origin(cmd);
+	if(o == INVALID_SID)
+		return true;
+	if(o == Hub::instance()->getSid() || !remoteHubs.count(o))
+		return false;
+	return getTree(o).from == from;
+}
+
 void ServerManager::broadcast(const Command& cmd, ConnectionBase* except) throw()
 {
 	typedef Interhubs::const_iterator CI;
-	Buffer::Ptr tmp(new Buffer(cmd));
+	// changes to our own users go in the log for links that come back
+	sid_type mask = getHubSidMask();
+	sid_type us = Hub::instance()->getSid() & mask;
+	if(cmd == (Command::INF | 'B') && (cmd.getSource() & mask) == us) {
+		SyncLog::instance()->record(cmd);
+	} else if(cmd == (Command::QUI | 'I')) {
+		try {
+			if((ADC::toSid(cmd[0]) & mask) == us)
+				SyncLog::instance()->record(cmd);
+		} catch(const parse_error&) {}
+	}
+
+	// SINFs go everywhere, and SQ takes care of the copies; the rest
+	// follow the shortest ways out from where they started
+	const Interhubs* to = &interhubs;
+	sid_type o = origin(cmd);
+	if(cmd != (Command::INF | 'S') && o != INVALID_SID)
+		to = &getTree(o).to;
+	else if(o == INVALID_SID && except && except->hasSupport("IHUB"))
+		return;	// can't tell where it's been
+
+	// quits and hub INFs go ahead of the rest; an SQUI only after
+	// everything that's waiting, since it's about all of a hub's users
+	bool control = cmd.getCmd() == Command::QUI || cmd == (Command::INF | 'S');
+	sid_type from = cmd.getSource();
+	if(cmd == (Command::QUI | 'I')) {
+		try {
+			from = ADC::toSid(cmd[0]);
+		} catch(const parse_error&) {}
+	} else if(cmd == (Command::QUI | 'S')) {
+		from = INVALID_SID;
+	}
+
+	uint8_t tth[TigerHash::HASH_SIZE];
+	bool tr = HashBloom::searchedTth(cmd, tth);
 
-	for(CI i = interhubs.begin(); i != interhubs.end(); ++i)
-		if(*i != except)
-			(*i)->getSocket()->writeb(tmp);
+	// made once for all the links that take it as a line, and once for
+	// those that take frames
+	Buffer::Ptr line, frame;
+	for(CI i = to->begin(); i != to->end(); ++i) {
+		if(*i == except || (tr && !(*i)->getBloom().match(tth)))
+			continue;
+		Buffer::Ptr& b = (*i)->isFramed() ? frame : line;
+		if(!b)
+			b = (*i)->pack(cmd);
+		(*i)->queue(cmd, b, from, control);
+	}
 }
 
 void ServerManager::direct(sid_type s, const Command& cmd) throw()
 {
 	RemoteHubs::const_iterator i = remoteHubs.find(s);
-	if(i != remoteHubs.end())
-		i->second->getInterHub()->send(cmd);
+	InterHub* ih = i != remoteHubs.end() ? i->second->getInterHub() : NULL;
+	if(ih)
+		ih->queue(cmd, ih->pack(cmd), cmd.getSource(), false);
+}
+
+string ServerManager::getRouteStatus() throw()
+{
+	ostringstream os;
+	for(RemoteHubs::iterator i = remoteHubs.begin(); i != remoteHubs.end(); ++i) {
+		RemoteHub* h = i->second;
+		if(i != remoteHubs.begin())
+			os << '\n';
+		os << ADC::fromSid(i->first) << ' ' << h->getUserInfo()->getNick() << ": ";
+		if(!h->next)
+			os << "no way there";
+		else if(h->hops)
+			os << h->hops << (h->hops == 1 ? " hop" : " hops") << " via "
+					<< h->next->getSocket()->getPeerName();
+		else
+			os << "off the map, via " << h->next->getSocket()->getPeerName();
+		if(!h->isMesh())
+			os << " (doesn't draw the map)";
+	}
+	return os.str();
+}
+
+int ServerManager::getRtt(sid_type a, sid_type b) throw()
+{
+	sid_type us = Hub::instance()->getSid();
+	if(b == us)
+		std::swap(a, b);
+	if(a == us) {
+		for(Interhubs::iterator i = interhubs.begin(); i != interhubs.end(); ++i)
+			if((*i)->getPeer() == b && (*i)->getAvgRtt())
+				return ((*i)->getAvgRtt() + 500) / 1000;
+	}
+	// what either end says
+	int n = 0, sum = 0;
+	RemoteHubs::iterator h = remoteHubs.find(a);
+	if(h != remoteHubs.end() && h->second->getRtt(b) >= 0) {
+		sum += h->second->getRtt(b);
+		++n;
+	}
+	h = remoteHubs.find(b);
+	if(h != remoteHubs.end() && h->second->getRtt(a) >= 0) {
+		sum += h->second->getRtt(a);
+		++n;
+	}
+	return n ? (sum + n / 2) / n : -1;
+}
+
+string ServerManager::getName(sid_type s) throw()
+{
+	if(s == Hub::instance()->getSid())
+		return ADC::fromSid(s) + ' ' + Hub::instance()->getName();
+	RemoteHubs::iterator h = remoteHubs.find(s);
+	return ADC::fromSid(s) + (h == remoteHubs.end() ? string() : ' ' + h->second->getUserInfo()->getNick());
 }
 
+string ServerManager::getLatencyStatus() throw()
+{
+	ostringstream os;
+	os.setf(ios::fixed);
+	os.precision(2);
+	os << "Our links:";
+	for(Interhubs::iterator i = interhubs.begin(); i != interhubs.end(); ++i) {
+		InterHub* ih = *i;
+		os << "\n  " << (ih->getPeer() == INVALID_SID ? string("?") : getName(ih->getPeer()))
+				<< " (" << ih->getSocket()->getPeerName() << "): ";
+		if(!ih->getAvgRtt()) {
+			os << (ih->hasSupport("PING") && pingInterval > 0 ? "not timed yet" : "not timed");
+			continue;
+		}
+		os << ih->getRtt() / 1000.0 << " ms, average " << ih->getAvgRtt() / 1000.0
+				<< " ms, jitter " << ih->getJitter() / 1000.0 << " ms, "
+				<< ih->getPingsLost() << " of " << ih->getPings() << " pings lost";
+	}
+	os << "\nThe map (average round trips):";
+	for(Graph::iterator i = graph.begin(); i != graph.end(); ++i) {
+		for(set<sid_type>::iterator j = i->second.begin(); j != i->second.end(); ++j) {
+			if(*j < i->first)
+				continue;
+			int r = getRtt(i->first, *j);
+			os << "\n  " << getName(i->first) << " - " << getName(*j) << ": ";
+			if(r < 0)
+				os << '?';
+			else
+				os << r << " ms";
+		}
+	}
+	return os.str();
+}
+
+string ServerManager::getTopologyHints() throw()
+{
+	// the map as a matrix, with one-way delays (half the round trip, and
+	// linkdelay for the batching at each end), -1 where we can't tell
+	vector<sid_type> hubs;
+	hubs.push_back(Hub::instance()->getSid());
+	for(Graph::iterator i = graph.begin(); i != graph.end(); ++i)
+		if(i->first != hubs.front())
+			hubs.push_back(i->first);
+	sort(hubs.begin(), hubs.end());
+	size_t n = hubs.size();
+	map<sid_type, size_t> index;
+	for(size_t i = 0; i < n; ++i)
+		index[hubs[i]] = i;
+	vector<vector<int> > delay(n, vector<int>(n, -1));
+	vector<vector<bool> > linked(n, vector<bool>(n, false));
+	for(Graph::iterator i = graph.begin(); i != graph.end(); ++i) {
+		for(set<sid_type>::iterator j = i->second.begin(); j != i->second.end(); ++j) {
+			size_t a = index[i->first], b = index[*j];
+			int r = getRtt(i->first, *j);
+			linked[a][b] = true;
+			delay[a][b] = r < 0 ? -1 : r / 2 + linkDelay;
+		}
+	}
+
+	// hops and delay along the ways messages take: breadth-first, the
+	// lowest SIDs first, as route() does
+	vector<vector<int> > hops(n, vector<int>(n, 0)), along(n, vector<int>(n, 0));
+	for(size_t s = 0; s < n; ++s) {
+		vector<bool> seen(n, false);
+		deque<size_t> q;
+		seen[s] = true;
+		q.push_back(s);
+		while(!q.empty()) {
+			size_t u = q.front();
+			q.pop_front();
+			for(size_t v = 0; v < n; ++v) {
+				if(!linked[u][v] || seen[v])
+					continue;
+				seen[v] = true;
+				hops[s][v] = hops[s][u] + 1;
+				along[s][v] = along[s][u] < 0 || delay[u][v] < 0 ? -1 : along[s][u] + delay[u][v];
+				q.push_back(v);
+			}
+		}
+	}
+
+	ostringstream os;
+	// the farthest apart, which a link between would bring closest
+	vector<pair<pair<int, int>, pair<size_t, size_t> > > far;
+	for(size_t a = 0; a < n; ++a)
+		for(size_t b = a + 1; b < n; ++b)
+			if(hops[a][b] >= 3)
+				far.push_back(make_pair(make_pair(-hops[a][b], -along[a][b]), make_pair(a, b)));
+	sort(far.begin(), far.end());
+	for(size_t i = 0; i < far.size() && i < 3; ++i) {
+		size_t a = far[i].second.first, b = far[i].second.second;
+		os << "\nLink " << getName(hubs[a]) << " and " << getName(hubs[b]) << ": they're "
+				<< hops[a][b] << " hops apart";
+		if(along[a][b] >= 0)
+			os << ", about " << along[a][b] << " ms one way";
+		os << ", and " << hops[a][b] - 1 << " hubs pass on what goes between them";
+	}
+	// links slower than a way round them, which messages don't take, as
+	// it's more hops
+	for(size_t a = 0; a < n; ++a) {
+		for(size_t b = a + 1; b < n; ++b) {
+			if(!linked[a][b] || delay[a][b] < 0)
+				continue;
+			int best = delay[a][b];
+			size_t via = n;
+			for(size_t c = 0; c < n; ++c) {
+				if(linked[a][c] && linked[c][b] && delay[a][c] >= 0 && delay[c][b] >= 0
+						&& delay[a][c] + delay[c][b] < best) {
+					best = delay[a][c] + delay[c][b];
+					via = c;
+				}
+			}
+			if(via == n)
+				continue;
+			os << "\nThe link between " << getName(hubs[a]) << " and " << getName(hubs[b])
+					<< " (about " << delay[a][b] << " ms one way) is slower than going through "
+					<< getName(hubs[via]) << " (" << best << " ms); traffic takes it as it's"
+					<< " fewer hops, so it may do better without it";
+		}
+	}
+	string ret = os.str();
+	if(ret.empty())
+		return "No hints: no two hubs are more than 2 hops apart, and no link is slower than a way round it.";
+	return "Hints:" + ret;
+}
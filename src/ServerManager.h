@@ -2,10 +2,13 @@
 #define QHUB_SERVERMANAGER_H
 
 #include "qhub.h"
+#include "EventManager.h"
 #include "Singleton.h"
 #include "UserInfo.h"
 
+#include <ctime>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -14,33 +17,112 @@ namespace qhub {
 class RemoteHub {
 public:
 	RemoteHub(const UserInfo& u, InterHub* i) throw()
-			: ui(u), ih(i) {}
+			: ui(u), via(i), next(i), hops(0), seq(0), lost(0) { parse(); }
 	~RemoteHub() throw() {}
 
 	UserInfo* getUserInfo() throw() { return &ui; }
-	InterHub* getInterHub() throw() { return ih; }
+	// the link to send to it through
+	InterHub* getInterHub() throw() { return next; }
+	// links away, or 0 if it isn't on the map
+	int getHops() const throw() { return hops; }
+	// it says which hubs it's linked to (LK), and numbers what it says (SQ)
+	bool isMesh() const throw() { return seq != 0; }
+	// its average round trip to hub s in milliseconds, as it says (LT);
+	// -1 if it doesn't
+	int getRtt(sid_type s) const throw();
 
 private:
+	friend class ServerManager;
+
+	// picks SQ, LK and LT out of ui
+	void parse() throw();
+	bool linksTo(sid_type s) const throw() { return links.count(s); }
+
 	UserInfo ui;
-	InterHub* ih;
+	// the link its SINF last came in on; NULL once that's gone
+	InterHub* via;
+	InterHub* next;
+	int hops;
+	uint32_t seq;
+	std::set<sid_type> links;
+	std::map<sid_type, int> rtts;
+	// when it went off the map, if it's been off since
+	time_t lost;
 };
 
-class ServerManager : public Singleton<ServerManager> {
+/*
+ * Hubs and the links between them.
+ *
+ * Hubs that know this say in their SINF which hubs they're linked to (LK)
+ * and number each SINF they send (SQ), so that every hub can draw the
+ * same map of the network and throw away SINFs it has already seen when
+ * they come round again.  Messages for one hub go the shortest way there;
+ * broadcasts go out along the shortest ways from the hub they started at,
+ * so in a mesh each hub gets them once, and any that turn up on another
+ * link are dropped.  Hubs that don't draw the map are reached through the
+ * link they were heard of on, as in a tree.
+ */
+class ServerManager : public Singleton<ServerManager>, public EventListener {
 public:
-	void add(sid_type sid, UserInfo const& ui, InterHub* conn) throw();
+	// false if it was old news and shouldn't be passed on
+	bool add(sid_type sid, UserInfo const& ui, InterHub* conn) throw();
 	void remove(sid_type sid) throw();
+	// hub sid and its users are gone from the network
+	void split(sid_type sid) throw();
+	// from says (SQUI) hub sid is gone; true if we split it too
+	bool quit(sid_type sid, InterHub* from) throw();
+	// in the order they can be reached, nearest first
 	void getInterList(InterHub* ih) throw();
 	void activate(InterHub* ih) throw();
+	// ih knows who's at the other end now
+	void peered(InterHub* ih) throw();
+	// splits off the hubs that can't be reached without ih, telling the
+	// other links
 	void deactivate(InterHub* ih) throw();
 	bool hasServer(sid_type) const throw();
 	sid_type getHubSidMask() const throw() { return sidMask; }
 	sid_type getClientSidMask() const throw() { return ~getHubSidMask(); }
 
+	// our own SINF
+	Command getInf() const throw();
+	// whether a broadcast that came in on from should be taken
+	bool accepts(const Command&, InterHub* from) throw();
+	// TTH searches only go to links whose bloom filter may have the file
 	void broadcast(const Command&, ConnectionBase* except) throw();
 	void direct(sid_type s, const Command&) throw();
 
+	// milliseconds a link holds bulk traffic (not QUI or SINF) back for,
+	// to send it with whatever comes after; 0 is not at all
+	int getLinkDelay() const throw() { return linkDelay; }
+	// bytes at which that goes out anyway
+	size_t getLinkBatch() const throw() { return linkBatch; }
+	// bytes waiting for a link at which it counts as congested (see
+	// InterHub::isCongested), and at which it's dropped
+	size_t getLinkQueue() const throw() { return linkQueue; }
+	size_t getLinkMax() const throw() { return linkMax; }
+	// whether links may switch to frames (see Frame) after the INF list;
+	// off unless asked for
+	bool getLinkFrames() const throw() { return linkFrames; }
+	// seconds between pings on each link; 0 is none
+	int getPingInterval() const throw() { return pingInterval; }
+
+	// sends our SINF to every link, with what we're linked to now, and
+	// how far
+	void advertise() throw();
+
+	// one line per hub, with how it's reached
+	std::string getRouteStatus() throw();
+	// our links' round trips, and those of the rest of the map
+	std::string getLatencyStatus() throw();
+	// links that would make for fewer hops or less delay on the map
+	std::string getTopologyHints() throw();
+
 	typedef std::map<sid_type, RemoteHub*> RemoteHubs;
 	typedef std::vector<InterHub*> Interhubs;
+	const Interhubs& getInterhubs() const throw() { return interhubs; }
+
+	// off-map hubs that have been long enough go
+	virtual void onTimer(int) throw();
 private:
 	friend class Singleton<ServerManager>;
 
@@ -52,6 +134,43 @@ private:
 	//for actual connections
 	Interhubs interhubs;
 
+	// numbers our SINFs; starts from the time, so it's still higher after
+	// a restart
+	uint32_t seq;
+	// seconds a hub may be off the map before we give up on it, when we
+	// can still send to it the way we heard of it
+	int holdTime;
+	bool waiting;
+	int linkDelay;
+	size_t linkBatch;
+	size_t linkQueue;
+	size_t linkMax;
+	bool linkFrames;
+	int pingInterval;
+
+	// who's linked to whom, both ways, as far as we can tell
+	typedef std::map<sid_type, std::set<sid_type> > Graph;
+	Graph graph;
+	// broadcasts from a hub come in on one link and go on to others
+	struct Tree {
+		Tree() throw() : from(NULL) {}
+		InterHub* from;
+		Interhubs to;
+	};
+	typedef std::map<sid_type, Tree> Trees;
+	Trees trees;
+
+	// the hub a broadcast started at; INVALID_SID if it doesn't say
+	sid_type origin(const Command&) const throw();
+	const Tree& getTree(sid_type origin) throw();
+	// average round trip between two hubs linked on the map, in
+	// milliseconds, as we or they time it; -1 if nobody does
+	int getRtt(sid_type a, sid_type b) throw();
+	// SID and nick
+	std::string getName(sid_type) throw();
+	// redraws the map and works out next hops, splitting whoever's gone
+	void route() throw();
+
 	ServerManager() throw();
 	~ServerManager() throw() {}
 };
@@ -4,6 +4,7 @@
 #include "ConnectionManager.h"
 #include "EventManager.h"
 #include "Logs.h"
+#include "Supervisor.h"
 
 using namespace std;
 using namespace qhub;
@@ -16,6 +17,13 @@ ServerSocket::ServerSocket(Domain domain, uint16_t port, ListenType t)
 	if(setsockopt(getFd(), SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
 		Logs::err << "warning: setsockopt:SO_REUSEADDR: " << Util::errnoToString(errno) << endl;
 	}
+#ifdef SO_REUSEPORT
+	// the kernel spreads connections over the workers
+	if(Supervisor::instance()->getProcesses() > 1
+			&& setsockopt(getFd(), SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1) {
+		Logs::err << "warning: setsockopt:SO_REUSEPORT: " << Util::errnoToString(errno) << endl;
+	}
+#endif
 
 	bind(Util::emptyString, port);	// empty = use INADDR_ANY
 	listen();
@@ -23,6 +23,19 @@ XmlTok* Settings::getConfig(const string& name) throw()
 		return root->addChild(name);
 }
 
+int Settings::getInt(XmlTok* p, const string& name, int def) throw()
+{
+	const string& v = p->getAttr(name);
+	if(v.empty())
+		return def;
+	try {
+		return Util::toInt(v);
+	} catch(const boost::bad_lexical_cast&) {
+		Logs::err << "bad " << name << " \"" << v << "\", using " << def << endl;
+		return def;
+	}
+}
+
 bool Settings::isValid() throw()
 {
 	return true
@@ -177,7 +190,7 @@ void Settings::parseArgs(int argc, char** argv)
 		Logs::setStat(vm["statfile"].as<string>());
 #ifdef DEBUG
 	if(vm.count("linefile"))
-		Logs::setLine(vm["statfile"].as<string>());
+		Logs::setLine(vm["linefile"].as<string>());
 #endif
 	if(vm.count("errfile"))
 		Logs::setErr(vm["errfile"].as<string>());
@@ -12,6 +12,9 @@ namespace qhub {
 class Settings : public Singleton<Settings> {
 public:
 	XmlTok* getConfig(const std::string& name) throw();
+	// attribute name of p as a number, or def if it's not there or not a
+	// number (which is logged)
+	static int getInt(XmlTok* p, const std::string& name, int def) throw();
 	std::string getConfigDir() throw() { return "."; }
 	bool isValid() throw();
 	void load() throw();
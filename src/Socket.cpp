@@ -1,20 +1,27 @@
 // vim:ts=4:sw=4:noet
 #include "Socket.h"
 
+#include "DeferredBuffer.h"
 #include "Logs.h"
+#include "ZStream.h"
 
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
 using namespace std;
 using namespace qhub;
 
 Socket::Socket(Domain d, int t, int p) throw(socket_error)
-		: fd(-1), domain(d), ip4OverIp6(false),
+		: fd(-1), domain(d), ip4OverIp6(false), source(NULL), queued(0), zstream(NULL), zbroken(false),
 		writeEnabled(false), written(0), disconnected(false)
 {
 	create();
@@ -30,7 +37,7 @@ Socket::Socket(Domain d, int t, int p) throw(socket_error)
 }
 
 Socket::Socket(int f, Domain d) throw()
-		: domain(d), ip4OverIp6(false),
+		: domain(d), ip4OverIp6(false), source(NULL), queued(0), zstream(NULL), zbroken(false),
 		writeEnabled(false), written(0), disconnected(false)
 {
 	fd = f;
@@ -40,6 +47,9 @@ Socket::Socket(int f, Domain d) throw()
 
 Socket::~Socket() throw()
 {
+	unblock();
+	delete source;
+	delete zstream;
 	destroy();
 }
 
@@ -61,6 +71,13 @@ void Socket::create() throw()
 		af = AF_INET6;
 		((struct sockaddr_in6*)saddrp)->sin6_family = af;
 #endif
+	} else if(domain == Socket::UNIX) {
+		saddrp = reinterpret_cast<struct sockaddr*>(new sockaddr_un);
+		saddrl = sizeof(sockaddr_un);
+		memset(saddrp, '\0', saddrl);
+		inaddrp = NULL;
+		af = AF_UNIX;
+		((struct sockaddr_un*)saddrp)->sun_family = af;
 	} else {
 		assert(0);
 	}
@@ -76,6 +93,9 @@ void Socket::destroy() throw()
 		delete (struct sockaddr_in6*)saddrp;
 	}
 #endif
+	else if(domain == Socket::UNIX) {
+		delete (struct sockaddr_un*)saddrp;
+	}
 }
 
 void Socket::connect(const string& ip, uint16_t port) throw(socket_error)
@@ -167,6 +187,8 @@ void Socket::disconnect(const string& msg)
 	Logs::err << getFd() << " disconnected: " << msg << endl;
 	EventManager::instance()->disableRead(getFd());
 	disconnected = true;
+	// no point streaming any more, but let what was held back get out
+	finishSource();
 }
 
 int Socket::read(void* buf, int len) throw(socket_error)
@@ -195,6 +217,12 @@ void Socket::write(string const& s, int prio) throw()
 
 void Socket::writeb(Buffer::Ptr b) throw()
 {
+	if(!b->ready()) {
+		// only plain ADC goes through a ZStream
+		assert(!zstream);
+		enqueue(b);
+		return;
+	}
 	if(b->size() == 0){
 		// no 0-byte sends, please
 		return;
@@ -202,6 +230,45 @@ void Socket::writeb(Buffer::Ptr b) throw()
 #ifdef DEBUG
 	Logs::line << getFd() << ">> " << string(b->data(), b->data() + b->size());
 #endif
+	if(zstream) {
+		try {
+			b = zstream->compress(*b);
+		} catch(const runtime_error& e) {
+			zstreamFailed(e);
+			return;
+		}
+	}
+	enqueue(b);
+}
+
+void Socket::writeb(Buffer::Ptr b, const ZBroadcast::Segment& s) throw()
+{
+	if(!zstream) {
+		writeb(b);
+		return;
+	}
+	if(b->size() == 0)
+		return;
+#ifdef DEBUG
+	Logs::line << getFd() << ">> " << string(b->data(), b->data() + b->size());
+#endif
+	try {
+		enqueue(zstream->compress(*b, s));
+	} catch(const runtime_error& e) {
+		zstreamFailed(e);
+	}
+}
+
+void Socket::enqueue(Buffer::Ptr b) throw()
+{
+	if(zbroken)
+		return;
+	if(!b->deferred())
+		queued += b->size();
+	if(source) {
+		held.push(b);
+		return;
+	}
 	queue.push(b);
 	if(!writeEnabled){
 		EventManager::instance()->enableWrite(getFd(), this);
@@ -209,11 +276,144 @@ void Socket::writeb(Buffer::Ptr b) throw()
 	}
 }
 
+int Socket::trySend(const Buffer& b) const throw()
+{
+	if(!queue.empty() || source || zstream || zbroken || disconnected
+			|| !b.ready() || b.size() == 0)
+		return -1;
+	int w = ::send(fd, b.data(), b.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+	if(w < 0)
+		// a real error will show up again in partialWrite
+		return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+	return w;
+}
+
+void Socket::writeRest(Buffer::Ptr b, int n) throw()
+{
+	if(n == (int)b->size())
+		return;
+	assert(queue.empty() && !written);
+	enqueue(b);
+	written = n;
+}
+
+void Socket::setZStream(ZStream* z) throw()
+{
+	assert(!zstream && "only one zlib stream per connection");
+	zstream = z;
+}
+
+void Socket::zstreamFailed(const runtime_error& e) throw()
+{
+	// the stream is garbage from here on; drop everything and let
+	// partialWrite disconnect us, since we may be in the middle of a
+	// broadcast right now
+	Logs::err << getFd() << " zlib stream failed: " << e.what() << endl;
+	clearQueue();
+	delete zstream;
+	zstream = NULL;
+	zbroken = true;
+	if(!writeEnabled){
+		EventManager::instance()->enableWrite(getFd(), this);
+		writeEnabled = true;
+	}
+}
+
+void Socket::setSource(SocketSource* s) throw()
+{
+	assert(!source && "only one source at a time");
+	source = s;
+	if(!writeEnabled){
+		EventManager::instance()->enableWrite(getFd(), this);
+		writeEnabled = true;
+	}
+}
+
+void Socket::finishSource() throw()
+{
+	delete source;
+	source = NULL;
+	while(!held.empty()) {
+		queue.push(held.front());
+		held.pop();
+	}
+}
+
+void Socket::wake() throw()
+{
+	if(!writeEnabled && !queue.empty()){
+		EventManager::instance()->enableWrite(getFd(), this);
+		writeEnabled = true;
+	}
+}
+
+bool Socket::blocked() const throw()
+{
+	return !queue.empty() && !queue.front()->ready();
+}
+
+void Socket::unblock() throw()
+{
+	if(blocked())
+		dynamic_cast<const DeferredBuffer&>(*queue.front()).forget(this);
+}
+
+void Socket::dequeue() throw()
+{
+	if(!queue.front()->deferred())
+		queued -= queue.front()->size();
+	queue.pop();
+}
+
+void Socket::clearQueue() throw()
+{
+	unblock();
+	delete source;
+	source = NULL;
+	while(!held.empty())
+		held.pop();
+	while(!queue.empty())
+		queue.pop();
+	queued = 0;
+}
+
 void Socket::partialWrite()
 {
-	assert(!queue.empty() && "We got a write-event though we got nothing to write");
+	if(zbroken) {
+		if(!disconnected)
+			disconnect("compression failure");
+		return;
+	}
+	// only ask the source for more once everything before it is out,
+	// so each writable event costs at most one chunk
+	while(queue.empty() && source) {
+		Buffer::Ptr b = source->next();
+		if(!b) {
+			finishSource();
+		} else if(!b->ready()) {
+			queue.push(b);
+		} else if(b->size()) {
+#ifdef DEBUG
+			Logs::line << getFd() << ">> " << string(b->data(), b->data() + b->size());
+#endif
+			queue.push(b);
+			queued += b->size();
+		}
+	}
+	if(queue.empty())
+		return;
 
 	Buffer::Ptr top = queue.front();
+	if(!top->ready()) {
+		// still being made; fill() wakes us up
+		dynamic_cast<const DeferredBuffer&>(*top).wait(this);
+		return;
+	}
+	if(top->size() == 0) {
+		// filled with nothing after all
+		dequeue();
+		return;
+	}
 
 	assert(written < (int)top->size() && "We have already written the entirety of this buffer");
 
@@ -222,8 +422,7 @@ void Socket::partialWrite()
 	if(w < 0){
 		switch(errno){
 		default:
-			while(!queue.empty())
-				queue.pop();
+			clearQueue();
 			disconnect(Util::toString(w) + ": write failed: " + Util::errnoToString(errno));
 			return;
 			break;
@@ -232,7 +431,7 @@ void Socket::partialWrite()
 		written += w;
 
 		if(written == (int)top->size()){
-			queue.pop();
+			dequeue();
 			written = 0;
 		}
 	}
@@ -303,6 +502,10 @@ void Socket::initSocketNames() throw()
 		}
 	}
 #endif //ENABLE_IPV6
+	else if(domain == Socket::UNIX) {
+		// socketpairs have no names to speak of
+		sockName = peerName = "unix";
+	}
 	else {
 		assert(0);
 	}
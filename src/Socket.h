@@ -5,10 +5,12 @@
 #include "Buffer.h"
 #include "EventManager.h"
 #include "Util.h"
+#include "ZBroadcast.h"
 
 #include <cerrno>
 #include <csignal>
 #include <queue>
+#include <stdexcept>
 #include <string>
 
 #include <sys/socket.h>
@@ -24,9 +26,23 @@
 
 namespace qhub {
 
+/*
+ * Produces output for a Socket on demand, one chunk per writable event.
+ * While a source is attached, everything else written to the socket is
+ * held back until the source runs dry, so its output stays contiguous.
+ */
+class SocketSource {
+public:
+	// returns the next chunk, or an empty pointer when there is no more
+	virtual Buffer::Ptr next() throw() = 0;
+
+	virtual ~SocketSource() throw() {}
+};
+
 class Socket : public EventListener {
 public:
 	enum Domain {
+		UNIX = PF_UNIX,	// only ever from socketpair(), see Supervisor
 		IP4 = PF_INET,
 #ifdef ENABLE_IPV6
 		IP6 = PF_INET6
@@ -52,6 +68,25 @@ public:
 	//beware: this will copy string. Limit use.
 	void write(std::string const& s, int prio = PRIO_NORM) throw();
 	void writeb(Buffer::Ptr b) throw();
+	// b compressed by the broadcast stream is s, for sockets with a ZStream
+	void writeb(Buffer::Ptr b, const ZBroadcast::Segment& s) throw();
+	// takes ownership; deleted once it runs dry or the socket goes away
+	void setSource(SocketSource* s) throw();
+	// takes ownership; everything written from now on goes through it
+	void setZStream(ZStream* z) throw();
+	bool hasZStream() const throw() { return zstream; }
+	// the next thing to write is ready now, if we were waiting for it
+	void wake() throw();
+	// writes as much of b as the kernel takes right away, if nothing else
+	// is waiting to go out and b needs no more work; -1 if it had to be left
+	// to writeb().  Doesn't touch the event loop, so it's safe from
+	// WorkerPool::runAll, one thread per socket
+	int trySend(const Buffer& b) const throw();
+	// trySend wrote n bytes of b; queue the rest
+	void writeRest(Buffer::Ptr b, int n) throw();
+
+	// bytes waiting to go out, not counting DeferredBuffers
+	size_t getQueued() const throw() { return queued; }
 
 	int getFd() const throw() { return fd; }
 	Domain getDomain() const throw() { return ip4OverIp6 ? IP4 : domain; };
@@ -72,7 +107,26 @@ protected:
 	//output queue
 	std::queue<Buffer::Ptr> queue;
 
+	//streamed output, and what was written while it was active
+	SocketSource* source;
+	std::queue<Buffer::Ptr> held;
+	//bytes in both
+	size_t queued;
+
+	//persistent ZLIF stream, if any
+	ZStream* zstream;
+	bool zbroken;
+
+	void enqueue(Buffer::Ptr b) throw();
+	// the front of the queue is out
+	void dequeue() throw();
+	// waiting for a DeferredBuffer to be filled
+	bool blocked() const throw();
+	void unblock() throw();
+	void zstreamFailed(const std::runtime_error& e) throw();
 	void partialWrite();
+	void clearQueue() throw();
+	void finishSource() throw();
 	bool writeEnabled;
 	//how much written for topmost Buffer
 	int written;
@@ -0,0 +1,126 @@
+// vim:ts=4:sw=4:noet
+#include "Supervisor.h"
+
+#include "Logs.h"
+#include "Settings.h"
+#include "Util.h"
+#include "XmlTok.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace qhub;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onStop(int)
+{
+	stopping = 1;
+}
+
+void Supervisor::start() throw()
+{
+	const string& p = Settings::instance()->getConfig("__hub")->getAttr("processes");
+	processes = p.empty() ? 1 : max(1, Util::toInt(p));
+	if(processes == 1)
+		return;
+
+	// ends[i][j] is i's end of the link between i and j
+	vector<vector<int> > ends(processes, vector<int>(processes, -1));
+	for(int i = 0; i < processes; ++i) {
+		for(int j = i + 1; j < processes; ++j) {
+			int sv[2];
+			if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+				Logs::err << "socketpair: " << Util::errnoToString(errno) << ": FATAL" << endl;
+				exit(EXIT_FAILURE);
+			}
+			ends[i][j] = sv[0];
+			ends[j][i] = sv[1];
+		}
+	}
+
+	for(int i = 0; i < processes; ++i) {
+		pid_t pid = fork();
+		if(pid < 0) {
+			Logs::err << "fork: " << Util::errnoToString(errno) << ": FATAL" << endl;
+			stop();
+			exit(EXIT_FAILURE);
+		}
+		if(pid == 0) {
+			index = i;
+			pids.clear();
+			for(int a = 0; a < processes; ++a) {
+				for(int b = 0; b < processes; ++b) {
+					if(a == i && b != i)
+						links.push_back(make_pair(ends[a][b], a < b));
+					else if(ends[a][b] != -1)
+						close(ends[a][b]);
+				}
+			}
+			Logs::stat << "Worker " << i << " of " << processes << ", pid " << getpid() << endl;
+			return;
+		}
+		pids.push_back(pid);
+	}
+
+	for(int a = 0; a < processes; ++a)
+		for(int b = 0; b < processes; ++b)
+			if(ends[a][b] != -1)
+				close(ends[a][b]);
+	supervise();
+}
+
+void Supervisor::supervise() throw()
+{
+	// no SA_RESTART, so waitpid() hears of them
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onStop;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	int ret = EXIT_SUCCESS;
+	bool stopped = false;
+	size_t left = pids.size();
+	while(left > 0) {
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if(pid < 0 && errno != EINTR)
+			break;
+		if(pid > 0) {
+			vector<pid_t>::iterator i = find(pids.begin(), pids.end(), pid);
+			if(i == pids.end())
+				continue;
+			*i = 0;
+			--left;
+			if(!stopped) {
+				Logs::err << "Worker " << i - pids.begin() << " stopped ("
+						<< (WIFSIGNALED(status) ? "signal " + Util::toString(WTERMSIG(status))
+						: "exit " + Util::toString(WEXITSTATUS(status)))
+						<< "), stopping the rest" << endl;
+				ret = EXIT_FAILURE;
+			}
+		}
+		if(!stopped && (stopping || pid > 0)) {
+			stopped = true;
+			stop();
+		}
+	}
+	exit(ret);
+}
+
+void Supervisor::stop() throw()
+{
+	for(vector<pid_t>::const_iterator i = pids.begin(); i != pids.end(); ++i)
+		if(*i > 0)
+			kill(*i, SIGTERM);
+}
@@ -0,0 +1,61 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_SUPERVISOR_H
+#define QHUB_SUPERVISOR_H
+
+#include "qhub.h"
+#include "Singleton.h"
+
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace qhub {
+
+/*
+ * With processes="N" in <__hub>, N > 1, the process we start as only
+ * forks N workers and waits for them.  Each worker is a hub of its own:
+ * it gets its own range of SIDs (see Hub), shares the client ports with
+ * the others through SO_REUSEPORT, and is linked to every other worker
+ * with an interhub link over a socketpair.  Only the first one opens the
+ * interhub ports and makes the <interconnect>s; to the rest of the
+ * network the others are hubs behind it.
+ *
+ * Workers never come back, so when one stops the rest are stopped too,
+ * and so is the supervisor.
+ */
+class Supervisor : public Singleton<Supervisor> {
+public:
+	// our end of a socketpair to another worker, and whether we're the
+	// one to start the link
+	typedef std::vector<std::pair<int, bool> > Links;
+
+	// forks the workers and returns in each of them, if there are to be
+	// any; otherwise returns right away
+	void start() throw();
+
+	// how many of us there are; 1 when not supervised
+	int getProcesses() const throw() { return processes; }
+	// which one we are, from 0
+	int getIndex() const throw() { return index; }
+	const Links& getLinks() const throw() { return links; }
+
+private:
+	friend class Singleton<Supervisor>;
+
+	int processes;
+	int index;
+	Links links;
+	std::vector<pid_t> pids;
+
+	// waits for the workers and exits once they're gone
+	void supervise() throw();
+	void stop() throw();
+
+	Supervisor() throw() : processes(1), index(0) {}
+	~Supervisor() throw() {}
+};
+
+} // namespace qhub
+
+#endif // QHUB_SUPERVISOR_H
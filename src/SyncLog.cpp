@@ -0,0 +1,88 @@
+// vim:ts=4:sw=4:noet
+#include "SyncLog.h"
+
+#include "ConnectionBase.h"
+#include "Encoder.h"
+#include "InterHub.h"
+#include "ServerManager.h"
+#include "Settings.h"
+#include "Util.h"
+#include "XmlTok.h"
+
+using namespace std;
+using namespace qhub;
+
+SyncLog::SyncLog() throw() : version(0), scheduled(false)
+{
+	const vector<uint8_t>& r = Util::genRand(8);
+	epoch = Encoder::toBase32(&r[0], r.size());
+
+	XmlTok* p = Settings::instance()->getConfig("__hub");
+	maxLog = Settings::getInt(p, "synclog", 16 * 1024);
+	keepTime = Settings::getInt(p, "syncghost", 10 * 60);
+}
+
+void SyncLog::record(const Command& cmd) throw()
+{
+	log.push_back(Change(++version, cmd));
+	while(log.size() > maxLog)
+		log.pop_front();
+	if(!scheduled) {
+		scheduled = true;
+		EventManager::instance()->addTimer(this, 0, 1);
+	}
+}
+
+bool SyncLog::has(const string& e, uint32_t v) const throw()
+{
+	if(e != epoch || v > version)
+		return false;
+	// the change right after v must still be there, if there is one
+	return v == version || (!log.empty() && log.front().version <= v + 1);
+}
+
+void SyncLog::sendSince(ConnectionBase* c, uint32_t v) const throw()
+{
+	// the one after v is at most this far from the end
+	deque<Change>::size_type n = version - v;
+	for(deque<Change>::const_iterator i = log.end() - n; i != log.end(); ++i)
+		c->send(i->cmd);
+}
+
+void SyncLog::keep(sid_type hsid, const string& e, uint32_t v, vector<Command>& infs) throw()
+{
+	time_t now = time(NULL);
+	// done here rather than on a timer, links don't go down that often
+	for(QHUB_FAST_MAP<sid_type, Kept>::iterator i = kept.begin(); i != kept.end(); ) {
+		if(i->second.since + keepTime <= now)
+			kept.erase(i++);
+		else
+			++i;
+	}
+	Kept& k = kept[hsid];
+	k.epoch = e;
+	k.version = v;
+	k.infs.swap(infs);
+	k.since = now;
+}
+
+SyncLog::Kept* SyncLog::getKept(sid_type hsid) throw()
+{
+	QHUB_FAST_MAP<sid_type, Kept>::iterator i = kept.find(hsid);
+	if(i == kept.end())
+		return NULL;
+	if(i->second.since + keepTime <= time(NULL)) {
+		kept.erase(i);
+		return NULL;
+	}
+	return &i->second;
+}
+
+void SyncLog::onTimer(int) throw()
+{
+	scheduled = false;
+	typedef ServerManager::Interhubs::const_iterator CI;
+	const ServerManager::Interhubs& links = ServerManager::instance()->getInterhubs();
+	for(CI i = links.begin(); i != links.end(); ++i)
+		(*i)->sendVersion();
+}
@@ -0,0 +1,85 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_SYNCLOG_H
+#define QHUB_SYNCLOG_H
+
+#include "qhub.h"
+#include "fast_map.h"
+#include "Command.h"
+#include "EventManager.h"
+#include "Singleton.h"
+
+#include <ctime>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace qhub {
+
+/*
+ * Lets interhub links that come back after a while exchange only what
+ * changed, instead of all users again.
+ *
+ * Every join, INF change and quit of a local user gets the next version
+ * and goes in a log of the last synclog (<__hub>) of them.  Versions
+ * count from 0 each time we start; the epoch, random, tells one run from
+ * the next.  A hub that had our users as of some version gets only the
+ * changes after it, if they're all still in the log.
+ *
+ * When a link to a hub that does this goes down, what we had of its users
+ * is kept for syncghost seconds, along with the version it was as of.
+ * Replaying changes we had already seen does no harm, so it doesn't matter
+ * that some may have come in after that version.
+ */
+class SyncLog : public Singleton<SyncLog>, public EventListener {
+public:
+	const std::string& getEpoch() const throw() { return epoch; }
+	uint32_t getVersion() const throw() { return version; }
+
+	// B INF or I QUI of a local user, as sent to other hubs
+	void record(const Command& cmd) throw();
+	// all changes after v of epoch e are in the log
+	bool has(const std::string& e, uint32_t v) const throw();
+	// sends c those changes; has(epoch, v) must be true
+	void sendSince(ConnectionBase* c, uint32_t v) const throw();
+
+	// the users (full BINFs) of hub hsid, as of version v of its epoch e
+	struct Kept {
+		std::string epoch;
+		uint32_t version;
+		std::vector<Command> infs;
+		time_t since;
+	};
+	void keep(sid_type hsid, const std::string& e, uint32_t v,
+			std::vector<Command>& infs) throw();
+	// NULL if there's nothing (recent) for hsid
+	Kept* getKept(sid_type hsid) throw();
+	void forget(sid_type hsid) throw() { kept.erase(hsid); }
+
+	// tells links what version their copy of our users is at
+	virtual void onTimer(int) throw();
+
+private:
+	friend class Singleton<SyncLog>;
+
+	std::string epoch;
+	uint32_t version;
+
+	struct Change {
+		Change(uint32_t v, const Command& c) throw() : version(v), cmd(c) {}
+		uint32_t version;
+		Command cmd;
+	};
+	std::deque<Change> log;
+	std::deque<Change>::size_type maxLog;
+	bool scheduled;
+
+	QHUB_FAST_MAP<sid_type, Kept> kept;
+	int keepTime;	// seconds
+
+	SyncLog() throw();
+	~SyncLog() throw() {}
+};
+
+} // namespace qhub
+
+#endif // QHUB_SYNCLOG_H
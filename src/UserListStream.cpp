@@ -0,0 +1,61 @@
+// vim:ts=4:sw=4:noet
+#include "UserListStream.h"
+
+#include "ClientManager.h"
+#include "CompressJob.h"
+#include "CompressionManager.h"
+#include "DeferredBuffer.h"
+#include "Deflater.h"
+#include "Logs.h"
+#include "UserInfo.h"
+#include "WorkerPool.h"
+
+using namespace std;
+using namespace qhub;
+
+UserListStream::UserListStream(vector<sid_type>& s, bool compress, const string* dict) throw()
+		: pos(0), finished(false)
+{
+	sids.swap(s);
+	if(compress) {
+		try {
+			zstream.reset(new Deflater(CompressionManager::instance()->getLevel()));
+			if(dict)
+				zstream->setDictionary(*dict);
+		} catch(const runtime_error& e) {
+			Logs::err << "sending userlist uncompressed: " << e.what() << endl;
+			zstream.reset();
+		}
+	}
+}
+
+Buffer::Ptr UserListStream::next() throw()
+{
+	if(finished)
+		return Buffer::Ptr();
+
+	bool first = pos == 0;
+	vector<uint8_t> out;
+	out.reserve(CHUNK_SIZE + 1024);
+	while(out.size() < CHUNK_SIZE && pos != sids.size()) {
+		sid_type sid = sids[pos++];
+		UserInfo* ui = ClientManager::instance()->getUserInfo(sid);
+		if(!ui)
+			continue; // left since we started
+		const string& inf = ui->toADC(sid).toString();
+		out.insert(out.end(), inf.begin(), inf.end());
+	}
+	finished = pos == sids.size();
+
+	Buffer::MutablePtr b(new Buffer);
+	b->swap(out);
+	if(!zstream)
+		return b;
+
+	// compressing is what takes the time; a worker does that, and the
+	// socket waits for it. The next chunk isn't asked for until this one
+	// has been written, so the stream is only ever worked on by one job.
+	DeferredBuffer::MutablePtr d(new DeferredBuffer);
+	WorkerPool::instance()->submit(new CompressJob(d, zstream, b, first, finished));
+	return d;
+}
@@ -0,0 +1,46 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_USERLISTSTREAM_H
+#define QHUB_USERLISTSTREAM_H
+
+#include "qhub.h"
+#include "Socket.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace qhub {
+
+/*
+ * Sends the userlist to a newly logged in client (or hub) a chunk at a
+ * time, as its socket drains, instead of building it all at once.  Only the
+ * SIDs are taken up front; INFs are serialized when their chunk is due, and
+ * users who have left by then are skipped.  With ZLIF the whole list is one
+ * IZON ... IZOF stream, sync-flushed at the end of every chunk, and the
+ * chunks are compressed by the WorkerPool.
+ */
+class UserListStream : public SocketSource {
+public:
+	// plain INF bytes per chunk
+	static const size_t CHUNK_SIZE = 16 * 1024;
+
+	// takes the contents of sids; dict is a preset dictionary the other
+	// end has too, and must outlive us
+	UserListStream(std::vector<sid_type>& sids, bool compress,
+			const std::string* dict = NULL) throw();
+	virtual ~UserListStream() throw() {}
+
+	virtual Buffer::Ptr next() throw();
+
+private:
+	std::vector<sid_type> sids;
+	std::vector<sid_type>::size_type pos;
+
+	boost::shared_ptr<Deflater> zstream;
+	bool finished;
+};
+
+} // namespace qhub
+
+#endif // QHUB_USERLISTSTREAM_H
@@ -0,0 +1,163 @@
+// vim:ts=4:sw=4:noet
+#include "WorkerPool.h"
+
+#include "Logs.h"
+#include "Settings.h"
+#include "Util.h"
+#include "XmlTok.h"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace qhub;
+
+WorkerPool::WorkerPool() throw()
+		: urgentLeft(0), stopping(false)
+{
+	const string& w = Settings::instance()->getConfig("__compression")->getAttr("workers");
+	int n = 2;
+	try {
+		if(!w.empty())
+			n = Util::toInt(w);
+	} catch(const boost::bad_lexical_cast&) {
+		Logs::err << "bad number of compression workers \"" << w << "\", using " << n << endl;
+	}
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&wakeup, NULL);
+	pthread_cond_init(&urgentDone, NULL);
+	if(n <= 0)
+		return;
+
+	if(pipe(pipefd) < 0) {
+		Logs::err << "no compression workers: pipe: " << Util::errnoToString(errno) << endl;
+		return;
+	}
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	EventManager::instance()->enableRead(pipefd[0], this);
+
+	for(int i = 0; i < n; ++i) {
+		pthread_t t;
+		if(pthread_create(&t, NULL, work, this) != 0) {
+			Logs::err << "could only start " << i << " compression workers" << endl;
+			break;
+		}
+		threads.push_back(t);
+	}
+	Logs::stat << "Compression workers: " << threads.size() << endl;
+}
+
+WorkerPool::~WorkerPool() throw()
+{
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_broadcast(&wakeup);
+	pthread_mutex_unlock(&lock);
+	for(vector<pthread_t>::iterator i = threads.begin(); i != threads.end(); ++i)
+		pthread_join(*i, NULL);
+	pthread_cond_destroy(&urgentDone);
+	pthread_cond_destroy(&wakeup);
+	pthread_mutex_destroy(&lock);
+}
+
+void WorkerPool::submit(Job* j) throw()
+{
+	if(threads.empty()) {
+		j->run();
+		j->done();
+		delete j;
+		return;
+	}
+	pthread_mutex_lock(&lock);
+	todo.push_back(j);
+	pthread_cond_signal(&wakeup);
+	pthread_mutex_unlock(&lock);
+}
+
+void WorkerPool::runAll(vector<Job*>& jobs) throw()
+{
+	if(threads.empty() || jobs.size() < 2) {
+		for(vector<Job*>::iterator i = jobs.begin(); i != jobs.end(); ++i)
+			(*i)->run();
+	} else {
+		pthread_mutex_lock(&lock);
+		urgent.insert(urgent.end(), jobs.begin(), jobs.end());
+		urgentLeft = jobs.size();
+		pthread_cond_broadcast(&wakeup);
+		while(!urgent.empty()) {
+			Job* j = urgent.front();
+			urgent.pop_front();
+			pthread_mutex_unlock(&lock);
+			j->run();
+			pthread_mutex_lock(&lock);
+			--urgentLeft;
+		}
+		// the rest are being run by workers
+		while(urgentLeft)
+			pthread_cond_wait(&urgentDone, &lock);
+		pthread_mutex_unlock(&lock);
+	}
+	for(vector<Job*>::iterator i = jobs.begin(); i != jobs.end(); ++i) {
+		(*i)->done();
+		delete *i;
+	}
+	jobs.clear();
+}
+
+void* WorkerPool::work(void* arg)
+{
+	WorkerPool* p = static_cast<WorkerPool*>(arg);
+	pthread_mutex_lock(&p->lock);
+	while(true) {
+		while(p->todo.empty() && p->urgent.empty() && !p->stopping)
+			pthread_cond_wait(&p->wakeup, &p->lock);
+		if(p->stopping)
+			break;
+		if(!p->urgent.empty()) {
+			Job* j = p->urgent.front();
+			p->urgent.pop_front();
+			pthread_mutex_unlock(&p->lock);
+			j->run();
+			pthread_mutex_lock(&p->lock);
+			if(--p->urgentLeft == 0)
+				pthread_cond_signal(&p->urgentDone);
+			continue;
+		}
+		Job* j = p->todo.front();
+		p->todo.pop_front();
+		pthread_mutex_unlock(&p->lock);
+
+		j->run();
+
+		pthread_mutex_lock(&p->lock);
+		bool wake = p->finished.empty();
+		p->finished.push_back(j);
+		if(wake) {
+			// one byte is enough until the event loop has looked
+			char c = 0;
+			::write(p->pipefd[1], &c, 1);
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+void WorkerPool::onRead(int) throw()
+{
+	char buf[64];
+	while(::read(pipefd[0], buf, sizeof(buf)) > 0)
+		;
+
+	deque<Job*> tmp;
+	pthread_mutex_lock(&lock);
+	tmp.swap(finished);
+	pthread_mutex_unlock(&lock);
+
+	for(deque<Job*>::iterator i = tmp.begin(); i != tmp.end(); ++i) {
+		(*i)->done();
+		delete *i;
+	}
+}
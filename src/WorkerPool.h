@@ -0,0 +1,73 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_WORKERPOOL_H
+#define QHUB_WORKERPOOL_H
+
+#include "qhub.h"
+#include "EventManager.h"
+#include "Singleton.h"
+
+#include <deque>
+#include <vector>
+
+#include <pthread.h>
+
+namespace qhub {
+
+/*
+ * Work that can be done off the event loop.  run() is called on a worker
+ * thread and must not touch anything but the job itself; done() is called
+ * back on the event loop afterwards, and the job is deleted after that.
+ */
+class Job {
+public:
+	virtual void run() throw() = 0;
+	virtual void done() throw() = 0;
+
+	virtual ~Job() throw() {}
+};
+
+/*
+ * Threads for Jobs.  Finished jobs are handed back through a pipe the
+ * event loop watches, so done() is always called from the event loop.
+ * With no workers (workers="0" in <__compression>) jobs just run inline.
+ *
+ * runAll() is the other way to use them: the event loop stops until the
+ * jobs are all done, and helps with them meanwhile.  As nothing else runs
+ * then, their run() may touch things the event loop owns, as long as no
+ * two of them touch the same thing.
+ */
+class WorkerPool : public Singleton<WorkerPool>, public EventListener {
+public:
+	// takes ownership
+	void submit(Job* j) throw();
+	bool hasWorkers() const throw() { return !threads.empty(); }
+	size_t getWorkers() const throw() { return threads.size(); }
+	// runs them all, calls their done() and deletes them before returning
+	void runAll(std::vector<Job*>& jobs) throw();
+
+	virtual void onRead(int fd) throw();
+
+private:
+	friend class Singleton<WorkerPool>;
+
+	std::vector<pthread_t> threads;
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	std::deque<Job*> todo;
+	std::deque<Job*> finished;
+	// from runAll; taken before todo
+	std::deque<Job*> urgent;
+	size_t urgentLeft;
+	pthread_cond_t urgentDone;
+	int pipefd[2];
+	bool stopping;
+
+	static void* work(void* arg);
+
+	WorkerPool() throw();
+	~WorkerPool() throw();
+};
+
+} // namespace qhub
+
+#endif // QHUB_WORKERPOOL_H
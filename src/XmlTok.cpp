@@ -134,7 +134,7 @@ XmlTok* XmlTok::addChild(string const& n) throw()
 
 void XmlTok::setAttr(string const& n, string const& attr) throw()
 {
-	attributes.insert(make_pair(n, attr));
+	attributes[n] = attr;
 }
 
 void XmlTok::setData(string const& d) throw()
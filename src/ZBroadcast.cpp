@@ -0,0 +1,37 @@
+// vim:ts=4:sw=4:noet
+#include "ZBroadcast.h"
+
+#include <vector>
+
+using namespace std;
+using namespace qhub;
+
+ZBroadcast::ZBroadcast(int level, size_t k) throw(runtime_error)
+		: zstream(level, true), keyInterval(k), sinceKey(0), seq(0)
+{
+}
+
+ZBroadcast::Segment ZBroadcast::compress(const Buffer& plain) throw(runtime_error)
+{
+	Segment s;
+	s.seq = ++seq;
+	s.key = s.seq == 1 || sinceKey >= keyInterval;
+	if(s.key && s.seq != 1) {
+		// the last segment ended on a sync flush, so starting over is safe
+		zstream.reset();
+		sinceKey = 0;
+	}
+	sinceKey += plain.size();
+
+	vector<uint8_t> out;
+	try {
+		zstream.write(plain.data(), plain.size(), out, Z_SYNC_FLUSH);
+	} catch(const runtime_error&) {
+		sinceKey = keyInterval; // start clean next time
+		throw;
+	}
+	Buffer::MutablePtr b(new Buffer);
+	b->swap(out);
+	s.data = b;
+	return s;
+}
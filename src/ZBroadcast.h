@@ -0,0 +1,46 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_ZBROADCAST_H
+#define QHUB_ZBROADCAST_H
+
+#include "qhub.h"
+#include "Buffer.h"
+#include "Deflater.h"
+
+#include <stdexcept>
+
+#include <boost/noncopyable.hpp>
+
+namespace qhub {
+
+/*
+ * One raw deflate stream that every broadcast batch is compressed into,
+ * so a batch is compressed once no matter how many ZStreams it goes out
+ * on.  A segment only decodes right after the segment before it, so a
+ * connection that got anything else in between has to wait for the next
+ * keyframe, which starts over with no history.
+ */
+class ZBroadcast : boost::noncopyable {
+public:
+	struct Segment {
+		Segment() : seq(0), key(false) {}
+
+		Buffer::Ptr data;
+		uint32_t seq;
+		bool key;		// references nothing before it
+	};
+
+	// a keyframe after every keyInterval plain bytes
+	ZBroadcast(int level, size_t keyInterval) throw(std::runtime_error);
+
+	Segment compress(const Buffer& plain) throw(std::runtime_error);
+
+private:
+	Deflater zstream;
+	size_t keyInterval;
+	size_t sinceKey;
+	uint32_t seq;
+};
+
+} // namespace qhub
+
+#endif // QHUB_ZBROADCAST_H
@@ -4,29 +4,22 @@
 
 #include "Buffer.h"
 
-#include <zlib.h>
+#include <stdexcept>
 
 namespace qhub {
 
+/*
+ * The IZON ... IZOF compressed form of an already serialized batch, so a
+ * batch is only turned into wire bytes once whether it goes out plain,
+ * compressed or both.  The Deflater is reset and reused rather than set
+ * up afresh for every batch, and the output goes straight into our own
+ * vector.
+ */
 class ZBuffer : public Buffer {
 public:
-	explicit ZBuffer(Command const& c, int p=0);
-	explicit ZBuffer(int p=0);
-	virtual ~ZBuffer();
-
-	virtual void append(const Command& cmd);
-
-	virtual void finalize();
-
-	virtual const uint8_t* data() const;
-	virtual std::vector<uint8_t>::size_type size() const;
+	ZBuffer(const Buffer& plain, Deflater& zstream, int p=0) throw(std::runtime_error);
 
 	typedef boost::shared_ptr<ZBuffer> MutablePtr;
-protected:
-	void init();
-
-	bool finalized;
-	z_streamp zcontext;
 };
 
 } // namespace qhub
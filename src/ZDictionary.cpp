@@ -0,0 +1,41 @@
+// vim:ts=4:sw=4:noet
+#include "ZDictionary.h"
+
+#include "Logs.h"
+#include "Settings.h"
+#include "XmlTok.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <zlib.h>
+
+using namespace std;
+using namespace qhub;
+
+ZDictionary::ZDictionary() throw()
+{
+	const string& fn = Settings::instance()->getConfig("__hub")->getAttr("zlibdict");
+	if(fn.empty())
+		return;
+
+	ifstream f(fn.c_str(), ios::binary);
+	dict.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+	if(!f.good() && !f.eof()) {
+		Logs::err << "could not load zlib dictionary " << fn << endl;
+		dict.clear();
+		return;
+	}
+	if(dict.empty())
+		return;
+	// anything past the window can never be referenced
+	if(dict.size() > 32 * 1024)
+		dict.erase(0, dict.size() - 32 * 1024);
+
+	char buf[9];
+	snprintf(buf, sizeof(buf), "%08lx",
+			adler32(adler32(0, NULL, 0), reinterpret_cast<const Bytef*>(dict.data()), dict.size()));
+	id = buf;
+	Logs::stat << "zlib dictionary " << fn << ": " << dict.size() << " bytes, id " << id << endl;
+}
@@ -0,0 +1,36 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_ZDICTIONARY_H
+#define QHUB_ZDICTIONARY_H
+
+#include "qhub.h"
+#include "Singleton.h"
+
+#include <string>
+
+namespace qhub {
+
+/*
+ * Preset zlib dictionary of typical ADC traffic (see tools/qhub-mkdict),
+ * named by the zlibdict attribute of <__hub>.  Only used on links where
+ * the other end said it has the same one, identified by its adler32.
+ */
+class ZDictionary : public Singleton<ZDictionary> {
+public:
+	bool empty() const throw() { return dict.empty(); }
+	const std::string& get() const throw() { return dict; }
+	// adler32 of the dictionary, in hex, as sent in LSUP
+	const std::string& getId() const throw() { return id; }
+
+private:
+	friend class Singleton<ZDictionary>;
+
+	std::string dict;
+	std::string id;
+
+	ZDictionary() throw();
+	~ZDictionary() throw() {}
+};
+
+} // namespace qhub
+
+#endif // QHUB_ZDICTIONARY_H
@@ -0,0 +1,62 @@
+// vim:ts=4:sw=4:noet
+#include "ZStream.h"
+
+#include "Command.h"
+
+#include <vector>
+
+using namespace std;
+using namespace qhub;
+
+ZStream::ZStream(int level) throw(runtime_error)
+		: own(level, true), started(false), inBroadcast(false), lastSeq(0), ownStale(false)
+{
+}
+
+void ZStream::begin(vector<uint8_t>& out) throw()
+{
+	// so other end knows zlib stream is starting
+	const string& zon = Command('I', Command::ZON).toString();
+	out.insert(out.end(), zon.begin(), zon.end());
+	// zlib header: deflate, 32k window, no dictionary
+	out.push_back(0x78);
+	out.push_back(0xDA);
+	started = true;
+}
+
+Buffer::Ptr ZStream::compress(const Buffer& plain) throw(runtime_error)
+{
+	vector<uint8_t> out;
+	if(!started)
+		begin(out);
+	if(ownStale) {
+		own.reset();
+		ownStale = false;
+	}
+	inBroadcast = false;
+	own.write(plain.data(), plain.size(), out, Z_SYNC_FLUSH);
+
+	Buffer::MutablePtr b(new Buffer);
+	b->swap(out);
+	return b;
+}
+
+Buffer::Ptr ZStream::compress(const Buffer& plain, const ZBroadcast::Segment& s)
+		throw(runtime_error)
+{
+	if(!s.key && !(inBroadcast && s.seq == lastSeq + 1))
+		return compress(plain);
+
+	inBroadcast = true;
+	lastSeq = s.seq;
+	ownStale = true;
+	if(started)
+		return s.data;
+
+	vector<uint8_t> out;
+	begin(out);
+	out.insert(out.end(), s.data->data(), s.data->data() + s.data->size());
+	Buffer::MutablePtr b(new Buffer);
+	b->swap(out);
+	return b;
+}
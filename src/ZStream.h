@@ -0,0 +1,47 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_ZSTREAM_H
+#define QHUB_ZSTREAM_H
+
+#include "qhub.h"
+#include "Buffer.h"
+#include "Deflater.h"
+#include "ZBroadcast.h"
+
+#include <stdexcept>
+
+#include <boost/noncopyable.hpp>
+
+namespace qhub {
+
+/*
+ * A ZLIF stream that stays open for the rest of the connection.  Every
+ * write batch is sync-flushed into it, so later batches compress against
+ * what was sent before.  The deflate data itself is raw; the zlib header
+ * is written by hand after IZON, which lets segments of a ZBroadcast be
+ * passed on as they are whenever the other end is in step with it.
+ */
+class ZStream : boost::noncopyable {
+public:
+	explicit ZStream(int level) throw(std::runtime_error);
+
+	// output for this connection only
+	Buffer::Ptr compress(const Buffer& plain) throw(std::runtime_error);
+	// s is plain compressed by the broadcast stream; used if it decodes here
+	Buffer::Ptr compress(const Buffer& plain, const ZBroadcast::Segment& s)
+			throw(std::runtime_error);
+
+private:
+	Deflater own;
+	bool started;
+	// last thing sent was broadcast segment lastSeq
+	bool inBroadcast;
+	uint32_t lastSeq;
+	// own's history no longer matches what the other end has seen
+	bool ownStale;
+
+	void begin(std::vector<uint8_t>& out) throw();
+};
+
+} // namespace qhub
+
+#endif // QHUB_ZSTREAM_H
@@ -1,6 +1,8 @@
 // vim:ts=4:sw=4:noet
 #include "qhub.h"
+#include "BloomManager.h"
 #include "ClientManager.h"
+#include "CompressionManager.h"
 #include "ConnectionManager.h"
 #include "EventManager.h"
 #include "Hub.h"
@@ -8,6 +10,12 @@
 #include "PluginManager.h"
 #include "ServerManager.h"
 #include "Settings.h"
+#include "Supervisor.h"
+#include "SyncLog.h"
+#include "WorkerPool.h"
+#include "ZDictionary.h"
+
+#include <unistd.h>
 
 using namespace std;
 using namespace qhub;
@@ -44,19 +52,27 @@ int main(int argc, char **argv)
 
 	Settings::instance()->load(); // load settings from config file
 
+	// from here on we may be one of several workers
+	Supervisor::instance()->start();
+
+	// Init random number generator; SyncLog draws its epoch from it
+	srand(time(NULL) ^ getpid());
+
 	// make sure these are actually instantiated; their constructors
 	// load all of the configuration and bootstrap everything
 	Hub::instance();
+	CompressionManager::instance();
+	WorkerPool::instance();
 	ClientManager::instance();
 	ConnectionManager::instance();
 	ServerManager::instance();
+	BloomManager::instance();
+	SyncLog::instance();
+	ZDictionary::instance();
 
 	// try loading
 	PluginManager::instance()->open("loader");
 
-	// Init random number generator
-	srand(time(NULL));
-
 	// kind of ugly, should switch to setting these in
 	// Manager classes somewhere
 	SigHandler sh;
@@ -71,7 +87,8 @@ int main(int argc, char **argv)
 
 	// shutdown and save settings
 	PluginManager::instance()->removeAll();
-	Settings::instance()->save();
+	if(Supervisor::instance()->getIndex() == 0)
+		Settings::instance()->save();
 
 	return ret;
 }
@@ -29,31 +29,53 @@ const sid_type INVALID_SID = sid_type(-1);
 // forward declarations for classes
 class ADC;
 class ADCSocket;
+class BloomManager;
 class Buffer;
 class Client;
 class ClientManager;
 class Command;
+class CompressJob;
+class CompressionManager;
 class ConnectionBase;
 class ConnectionManager;
+class DeferredBuffer;
+class Deflater;
 class DnsManager;
 class Encoder;
 class EventManager;
+class FanOutJob;
+class Frame;
+class HashBloom;
 class Hub;
+class Inflater;
 class InterHub;
+class InterLink;
+class Job;
+class LocalUsers;
 class Logs;
+class NickIndex;
 class Plugin;
 class PluginManager;
+class SearchCache;
 class ServerManager;
 class ServerSocket;
 class Settings;
 class Socket;
+class SocketSource;
+class Supervisor;
+class SyncLog;
 class TigerHash;
 class TokenBucket;
 class UserData;
 class UserInfo;
+class UserListStream;
 class Util;
+class WorkerPool;
 class XmlTok;
+class ZBroadcast;
 class ZBuffer;
+class ZDictionary;
+class ZStream;
 
 } // namespace qhub
 
@@ -0,0 +1,43 @@
+// vim:ts=4:sw=4:noet
+#include "capture.h"
+
+using namespace std;
+
+static string stripPrefix(const string& l)
+{
+	string::size_type i = 0;
+	while(i < l.size() && l[i] >= '0' && l[i] <= '9')
+		++i;
+	if(i > 0 && (l.compare(i, 3, "<< ") == 0 || l.compare(i, 3, ">> ") == 0))
+		return l.substr(i + 3);
+	return l;
+}
+
+// ADC is always valid UTF-8 text
+static bool isText(const string& l)
+{
+	for(string::size_type i = 0; i < l.size(); ++i) {
+		unsigned char c = l[i];
+		if(c < 0x20 || c == 0x7f)
+			return false;
+		if(c < 0x80)
+			continue;
+		int n = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc2 ? 1 : -1;
+		if(n < 0 || c > 0xf4 || i + n >= l.size())
+			return false;
+		for(; n; --n)
+			if((l[++i] & 0xc0) != 0x80)
+				return false;
+	}
+	return true;
+}
+
+bool nextLine(istream& in, string& line)
+{
+	while(getline(in, line)) {
+		line = stripPrefix(line);
+		if(!line.empty() && isText(line))
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,15 @@
+// vim:ts=4:sw=4:noet
+#ifndef QHUB_TOOLS_CAPTURE_H
+#define QHUB_TOOLS_CAPTURE_H
+
+#include <istream>
+#include <string>
+
+/*
+ * Reads captured traffic, i.e. a --linefile log or plain ADC lines: the
+ * next line of ADC text, without the "fd<< " / "fd>> " a linefile puts in
+ * front of it.  Compressed output gets logged too and is skipped.
+ */
+bool nextLine(std::istream& in, std::string& line);
+
+#endif // QHUB_TOOLS_CAPTURE_H
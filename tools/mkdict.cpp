@@ -0,0 +1,90 @@
+// vim:ts=4:sw=4:noet
+/*
+ * Builds a preset zlib dictionary (see zlibdict in qhub.xml) from captured
+ * traffic, i.e. a --linefile log or plain ADC lines.  The dictionary is
+ * made of the parameters that turn up most often, weighted by length,
+ * with the most valuable last, since zlib finds close matches cheapest.
+ */
+#include "capture.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+
+static void usage()
+{
+	cerr << "usage: qhub-mkdict [-s size] capture > dictionary" << endl;
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+	size_t size = 16 * 1024;
+	int c;
+	while((c = getopt(argc, argv, "s:")) != -1) {
+		switch(c) {
+		case 's':
+			size = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if(optind != argc - 1 || size == 0 || size > 32 * 1024)
+		usage();
+
+	ifstream f(argv[optind]);
+	if(!f.good()) {
+		cerr << "could not open " << argv[optind] << endl;
+		return EXIT_FAILURE;
+	}
+
+	map<string, size_t> count;
+	string line;
+	size_t lines = 0;
+	while(nextLine(f, line)) {
+		if(line.size() < 4)
+			continue;
+		++lines;
+		// the command itself, then every parameter with the space in front
+		// of it; SIDs and CIDs are too random to make the cut anyway
+		++count[line.substr(0, 4)];
+		string::size_type i = 4;
+		while(i < line.size()) {
+			string::size_type j = line.find(' ', i + 1);
+			if(j == string::npos)
+				j = line.size();
+			++count[line.substr(i, j - i)];
+			i = j;
+		}
+	}
+
+	multimap<size_t, const string*> ranked;
+	for(map<string, size_t>::const_iterator i = count.begin(); i != count.end(); ++i)
+		if(i->second > 1)
+			ranked.insert(make_pair(i->second * i->first.size(), &i->first));
+
+	// take the best until full, then write them out worst first
+	vector<const string*> chosen;
+	size_t total = 0;
+	for(multimap<size_t, const string*>::reverse_iterator i = ranked.rbegin(); i != ranked.rend(); ++i) {
+		if(total + i->second->size() > size)
+			continue;
+		chosen.push_back(i->second);
+		total += i->second->size();
+	}
+	for(vector<const string*>::reverse_iterator i = chosen.rbegin(); i != chosen.rend(); ++i)
+		cout << **i;
+
+	cerr << lines << " lines, " << count.size() << " distinct tokens, "
+			<< chosen.size() << " in a " << total << " byte dictionary" << endl;
+	return EXIT_SUCCESS;
+}
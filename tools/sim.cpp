@@ -0,0 +1,638 @@
+// vim:ts=4:sw=4:noet
+/*
+ * Runs a network of qhub processes on loopback, linked in one of a few
+ * layouts, with synthetic users sending INFs, chat, searches, CTMs and
+ * quits at the given rates, and reports what each hub sent its users,
+ * what each link carried, the CPU time each hub used and how long chat,
+ * searches and CTMs took to arrive.  The links run through us, which is
+ * how their bytes are counted.
+ */
+#include "Encoder.h"
+#include "TigerHash.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// each hub gets 1 << (20 - HUB_SID_BITS) SIDs
+#define HUB_SID_BITS 6
+#define TICK 10000	// usec
+
+static uint64_t now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return uint64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static string str(int i)
+{
+	char buf[16];
+	sprintf(buf, "%d", i);
+	return buf;
+}
+
+static double rand01()
+{
+	return rand() / (RAND_MAX + 1.0);
+}
+
+static void die(const string& what);
+
+static int listenOn(int port)
+{
+	int fd = socket(PF_INET, SOCK_STREAM, 0);
+	int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(bind(fd, (sockaddr*)&sa, sizeof(sa)) < 0 || listen(fd, 64) < 0)
+		die("can't listen on port " + str(port) + ": " + strerror(errno));
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return fd;
+}
+
+// -1 if nobody's there (yet)
+static int connectTo(int port)
+{
+	int fd = socket(PF_INET, SOCK_STREAM, 0);
+	sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(connect(fd, (sockaddr*)&sa, sizeof(sa)) < 0) {
+		close(fd);
+		return -1;
+	}
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return fd;
+}
+
+// writes what it can of buf; false if fd is gone
+static bool flushOut(int fd, string& buf, uint64_t& bytes)
+{
+	while(!buf.empty()) {
+		ssize_t n = write(fd, buf.data(), buf.size());
+		if(n < 0)
+			return errno == EAGAIN || errno == EINTR;
+		buf.erase(0, n);
+		bytes += n;
+	}
+	return true;
+}
+
+// appends what there is to buf; false if fd is gone
+static bool readIn(int fd, string& buf, uint64_t& bytes)
+{
+	char tmp[16384];
+	for(;;) {
+		ssize_t n = read(fd, tmp, sizeof(tmp));
+		if(n == 0)
+			return false;
+		if(n < 0)
+			return errno == EAGAIN || errno == EINTR;
+		buf.append(tmp, n);
+		bytes += n;
+	}
+}
+
+struct Latency {
+	vector<uint32_t> samples;	// usec
+
+	void add(uint64_t us) { samples.push_back(us > 0xFFFFFFFFu ? 0xFFFFFFFFu : uint32_t(us)); }
+	string str()
+	{
+		if(samples.empty())
+			return "-";
+		sort(samples.begin(), samples.end());
+		double sum = 0;
+		for(size_t i = 0; i < samples.size(); ++i)
+			sum += samples[i];
+		char buf[64];
+		sprintf(buf, "%.2f/%.2f", sum / samples.size() / 1000,
+				samples[samples.size() * 99 / 100] / 1000.0);
+		return buf;
+	}
+};
+
+struct Hub {
+	pid_t pid;
+	int port, interport;
+	int users;
+	uint64_t toUsers, fromUsers;
+	Latency chat, search, ctm;
+	double cpu;	// seconds, while measuring
+};
+
+// hub b's interconnect to hub a, through us
+struct Link {
+	int a, b;
+	int port;
+	int lfd, fdA, fdB;
+	string toA, toB;
+	uint64_t ab, ba;
+	int downs;
+};
+
+struct User {
+	int idx;
+	int hub;
+	int fd;
+	string sid;
+	string pid, cid;
+	string in, out;
+	set<string> seen;	// until everybody's seen everybody
+};
+
+static vector<Hub> hubs;
+static vector<Link> links;
+static vector<User> users;
+static uint64_t disconnects = 0;
+
+static void stopHubs()
+{
+	for(size_t i = 0; i < hubs.size(); ++i)
+		if(hubs[i].pid > 0)
+			kill(hubs[i].pid, SIGTERM);
+	for(size_t i = 0; i < hubs.size(); ++i)
+		if(hubs[i].pid > 0)
+			waitpid(hubs[i].pid, NULL, 0);
+}
+
+static void die(const string& what)
+{
+	cerr << "qhub-sim: " << what << endl;
+	stopHubs();
+	exit(EXIT_FAILURE);
+}
+
+// user and system time of pid so far, -1 if we can't tell
+static double cpuTime(pid_t pid)
+{
+	char fn[64];
+	sprintf(fn, "/proc/%d/stat", (int)pid);
+	ifstream f(fn);
+	string stat((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+	// the name may have spaces; the rest comes after its ')'
+	string::size_type i = stat.rfind(')');
+	if(i == string::npos)
+		return -1;
+	unsigned long utime, stime;
+	if(sscanf(stat.c_str() + i + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			&utime, &stime) != 2)
+		return -1;
+	return double(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static void connectUser(User& u)
+{
+	// the hub may still be starting
+	for(int i = 0; (u.fd = connectTo(hubs[u.hub].port)) < 0; ++i) {
+		if(i == 50)
+			die("can't reach hub " + str(u.hub));
+		usleep(100000);
+	}
+	u.sid.clear();
+	u.in.clear();
+	u.out = "HSUP ADBASE ADTIGR\n";
+	u.seen.clear();
+}
+
+// the token our timed traffic carries: when it was sent and from which hub
+static string stamp(const User& u)
+{
+	char buf[64];
+	sprintf(buf, "t%llu.%d", (unsigned long long)now(), u.hub);
+	return buf;
+}
+
+static bool unstamp(const string& line, uint64_t& sent, int& from)
+{
+	string::size_type i = line.rfind(' ');
+	if(i == string::npos)
+		return false;
+	const char* p = line.c_str() + i + 1;
+	if(strncmp(p, "TO", 2) == 0)
+		p += 2;
+	unsigned long long t;
+	if(sscanf(p, "t%llu.%d", &t, &from) != 2)
+		return false;
+	sent = t;
+	return true;
+}
+
+static void handleLine(User& u, const string& l, vector<vector<Latency> >& matrix, bool warm)
+{
+	if(l.compare(0, 5, "ISID ") == 0) {
+		u.sid = l.substr(5, 4);
+		char buf[64];
+		sprintf(buf, " NIsim%d SL3 SS%d000000 SUTCP4", u.idx, rand() % 100000);
+		u.out += "BINF " + u.sid + " ID" + u.cid + " PD" + u.pid + buf + " VEqhub-sim\n";
+		return;
+	}
+	if(l.size() < 9 || u.sid.empty())
+		return;
+	if(!warm && l.compare(0, 5, "BINF ") == 0) {
+		u.seen.insert(l.substr(5, 4));
+		return;
+	}
+	if(!warm || l.compare(5, 4, u.sid) == 0)
+		return;
+	uint64_t sent;
+	int from;
+	if(!unstamp(l, sent, from) || from < 0 || from >= (int)hubs.size())
+		return;
+	uint64_t took = now() - sent;
+	Hub& h = hubs[u.hub];
+	if(l.compare(0, 5, "BMSG ") == 0) {
+		h.chat.add(took);
+		matrix[from][u.hub].add(took);
+	} else if(l.compare(0, 5, "BSCH ") == 0) {
+		h.search.add(took);
+	} else if(l.compare(0, 5, "DCTM ") == 0) {
+		h.ctm.add(took);
+	}
+}
+
+static void usage()
+{
+	cerr << "usage: qhub-sim [-k hubs] [-t chain|star|ring|mesh] [-m users] [-d seconds]\n"
+			"                [-r inf,chat,search,ctm,quit] [-p base port] [-q qhub] [-w dir]\n"
+			"rates are per user per minute; defaults: -k 3 -t chain -m 100 -d 20\n"
+			"-r 1,0.5,2,1,0.2 -p 24000 -q qhub" << endl;
+	exit(EXIT_FAILURE);
+}
+
+// fds to watch, and what for
+static void watch(vector<pollfd>& fds, int fd, bool out)
+{
+	pollfd p;
+	p.fd = fd;
+	p.events = POLLIN | (out ? POLLOUT : 0);
+	p.revents = 0;
+	fds.push_back(p);
+}
+
+static void linkDown(Link& l)
+{
+	if(l.fdA >= 0)
+		close(l.fdA);
+	if(l.fdB >= 0)
+		close(l.fdB);
+	l.fdA = l.fdB = -1;
+	l.toA.clear();
+	l.toB.clear();
+	++l.downs;
+}
+
+static void pumpLink(Link& l)
+{
+	int fd;
+	while((fd = accept(l.lfd, NULL, NULL)) >= 0) {
+		// b retrying; whatever it had is gone
+		if(l.fdB >= 0)
+			linkDown(l);
+		l.fdA = connectTo(hubs[l.a].interport);
+		if(l.fdA < 0) {
+			close(fd);
+			continue;
+		}
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		l.fdB = fd;
+	}
+	if(l.fdB < 0)
+		return;
+	uint64_t out = 0;
+	if(!readIn(l.fdB, l.toA, l.ba) || !readIn(l.fdA, l.toB, l.ab)
+			|| !flushOut(l.fdA, l.toA, out) || !flushOut(l.fdB, l.toB, out))
+		linkDown(l);
+}
+
+static void pumpUser(User& u, bool warm, vector<vector<Latency> >& matrix)
+{
+	Hub& h = hubs[u.hub];
+	if(readIn(u.fd, u.in, h.toUsers)) {
+		string::size_type i = 0, j;
+		while((j = u.in.find('\n', i)) != string::npos) {
+			handleLine(u, u.in.substr(i, j - i), matrix, warm);
+			i = j + 1;
+		}
+		u.in.erase(0, i);
+		if(flushOut(u.fd, u.out, h.fromUsers))
+			return;
+	}
+	// the hub threw it out
+	++disconnects;
+	close(u.fd);
+	connectUser(u);
+}
+
+// what each user does in dt seconds, at rates per minute
+static void act(double dt, const double* rates)
+{
+	for(size_t i = 0; i < users.size(); ++i) {
+		User& u = users[i];
+		if(u.sid.empty())
+			continue;
+		if(rand01() < rates[0] * dt / 60)
+			u.out += "BINF " + u.sid + " SS" + str(rand() % 100000) + "000000\n";
+		if(rand01() < rates[1] * dt / 60)
+			u.out += "BMSG " + u.sid + " " + stamp(u) + "\n";
+		if(rand01() < rates[2] * dt / 60)
+			u.out += "BSCH " + u.sid + " ANsim" + str(rand() % 1000) + " TO" + stamp(u) + "\n";
+		if(rand01() < rates[3] * dt / 60) {
+			const User& to = users[rand() % users.size()];
+			if(&to != &u && !to.sid.empty())
+				u.out += "DCTM " + u.sid + " " + to.sid + " ADC/1.0 412 " + stamp(u) + "\n";
+		}
+		if(rand01() < rates[4] * dt / 60) {
+			flushOut(u.fd, u.out, hubs[u.hub].fromUsers);
+			close(u.fd);
+			connectUser(u);
+		}
+	}
+}
+
+static void writeConfig(const string& dir, int i)
+{
+	string d = dir + "/hub" + str(i);
+	mkdir(d.c_str(), 0755);
+	ofstream f((d + "/qhub.xml").c_str());
+	f << "<qhub><__hub name=\"sim" << i << "\" hubsidbits=\"" << HUB_SID_BITS << "\" sid=\""
+			<< (i << (20 - HUB_SID_BITS)) << "\" interpass=\"sim\"/>"
+			<< "<__connections retrymin=\"1\" retrymax=\"4\">"
+			<< "<clientport>" << hubs[i].port << "</clientport>"
+			<< "<interport>" << hubs[i].interport << "</interport>";
+	for(size_t j = 0; j < links.size(); ++j)
+		if(links[j].b == i)
+			f << "<interconnect host=\"127.0.0.1\" port=\"" << links[j].port << "\" password=\"sim\"/>";
+	f << "</__connections></qhub>" << endl;
+	if(!f.good())
+		die("can't write " + d + "/qhub.xml");
+}
+
+static void startHub(const string& qhub, const string& dir, int i)
+{
+	string d = dir + "/hub" + str(i);
+	pid_t pid = fork();
+	if(pid < 0)
+		die("fork: " + string(strerror(errno)));
+	if(pid == 0) {
+		int fd = open((d + "/log").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		dup2(fd, 1);
+		dup2(fd, 2);
+		execlp(qhub.c_str(), qhub.c_str(), "-c", d.c_str(), (char*)NULL);
+		cerr << "can't run " << qhub << ": " << strerror(errno) << endl;
+		_exit(EXIT_FAILURE);
+	}
+	hubs[i].pid = pid;
+}
+
+int main(int argc, char** argv)
+{
+	int k = 3, m = 100, secs = 20, base = 24000;
+	string layout = "chain", qhub = "qhub", dir;
+	double rates[5] = { 1, 0.5, 2, 1, 0.2 };
+	int c;
+	while((c = getopt(argc, argv, "k:t:m:d:r:p:q:w:")) != -1) {
+		switch(c) {
+		case 'k':
+			k = atoi(optarg);
+			break;
+		case 't':
+			layout = optarg;
+			break;
+		case 'm':
+			m = atoi(optarg);
+			break;
+		case 'd':
+			secs = atoi(optarg);
+			break;
+		case 'r':
+			if(sscanf(optarg, "%lf,%lf,%lf,%lf,%lf", &rates[0], &rates[1], &rates[2],
+					&rates[3], &rates[4]) != 5)
+				usage();
+			break;
+		case 'p':
+			base = atoi(optarg);
+			break;
+		case 'q':
+			qhub = optarg;
+			break;
+		case 'w':
+			dir = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if(optind != argc || k < 1 || k > (1 << HUB_SID_BITS) || m < 1 || secs <= 0 || base <= 0
+			|| (layout != "chain" && layout != "star" && layout != "ring" && layout != "mesh"))
+		usage();
+
+	signal(SIGPIPE, SIG_IGN);
+	// the same traffic every time, so runs compare
+	srand(1);
+
+	if(dir.empty()) {
+		char tmpl[] = "/tmp/qhub-sim.XXXXXX";
+		if(!mkdtemp(tmpl))
+			die("mkdtemp: " + string(strerror(errno)));
+		dir = tmpl;
+	} else {
+		mkdir(dir.c_str(), 0755);
+	}
+
+	hubs.resize(k);
+	for(int i = 0; i < k; ++i) {
+		Hub& h = hubs[i];
+		h.pid = 0;
+		h.port = base + 2 * i;
+		h.interport = base + 2 * i + 1;
+		h.users = 0;
+		h.toUsers = h.fromUsers = 0;
+		h.cpu = 0;
+	}
+	for(int b = 1; b < k; ++b) {
+		for(int a = 0; a < b; ++a) {
+			bool link = layout == "mesh" || (layout == "star" ? a == 0 : a == b - 1)
+					|| (layout == "ring" && k > 2 && a == 0 && b == k - 1);
+			if(!link)
+				continue;
+			Link l;
+			l.a = a;
+			l.b = b;
+			l.port = base + 2 * k + links.size();
+			l.lfd = listenOn(l.port);
+			l.fdA = l.fdB = -1;
+			l.ab = l.ba = 0;
+			l.downs = 0;
+			links.push_back(l);
+		}
+	}
+	for(int i = 0; i < k; ++i) {
+		writeConfig(dir, i);
+		startHub(qhub, dir, i);
+	}
+
+	users.resize(m);
+	for(int i = 0; i < m; ++i) {
+		User& u = users[i];
+		u.idx = i;
+		u.hub = i % k;
+		++hubs[u.hub].users;
+		uint8_t pid[qhub::TigerHash::HASH_SIZE];
+		for(size_t j = 0; j < sizeof(pid); ++j)
+			pid[j] = rand();
+		qhub::TigerHash th;
+		th.update(pid, sizeof(pid));
+		th.finalize();
+		u.pid = qhub::Encoder::toBase32(pid, sizeof(pid));
+		u.cid = qhub::Encoder::toBase32(th.getResult(), qhub::TigerHash::HASH_SIZE);
+		connectUser(u);
+	}
+
+	vector<vector<Latency> > matrix(k, vector<Latency>(k));
+	uint64_t start = now(), warmed = 0, last = start;
+	bool warm = false;
+	vector<double> cpu(k);
+	vector<pollfd> fds;
+	for(;;) {
+		uint64_t t = now();
+		if(!warm) {
+			bool all = true;
+			for(size_t i = 0; i < users.size() && all; ++i)
+				all = (int)users[i].seen.size() >= m;
+			if(all || t - start > 30 * 1000000ULL) {
+				if(!all)
+					cerr << "qhub-sim: not everybody sees everybody after 30 s; going on" << endl;
+				// from here on we count
+				warm = true;
+				warmed = t;
+				for(int i = 0; i < k; ++i) {
+					hubs[i].toUsers = hubs[i].fromUsers = 0;
+					cpu[i] = cpuTime(hubs[i].pid);
+				}
+				for(size_t i = 0; i < links.size(); ++i) {
+					links[i].ab = links[i].ba = 0;
+					links[i].downs = 0;
+				}
+				for(size_t i = 0; i < users.size(); ++i)
+					users[i].seen.clear();
+				disconnects = 0;
+			}
+		} else if(t - warmed >= secs * 1000000ULL) {
+			break;
+		}
+		if(t - last >= TICK) {
+			if(warm)
+				act((t - last) / 1e6, rates);
+			last = t;
+		}
+
+		fds.clear();
+		for(size_t i = 0; i < links.size(); ++i) {
+			watch(fds, links[i].lfd, false);
+			if(links[i].fdB >= 0) {
+				watch(fds, links[i].fdA, !links[i].toA.empty());
+				watch(fds, links[i].fdB, !links[i].toB.empty());
+			}
+		}
+		for(size_t i = 0; i < users.size(); ++i)
+			watch(fds, users[i].fd, !users[i].out.empty());
+		poll(&fds[0], fds.size(), 1 + (last + TICK - min(now(), last + TICK)) / 1000);
+
+		for(size_t i = 0; i < links.size(); ++i)
+			pumpLink(links[i]);
+		for(size_t i = 0; i < users.size(); ++i)
+			pumpUser(users[i], warm, matrix);
+
+		for(int i = 0; i < k; ++i)
+			if(waitpid(hubs[i].pid, NULL, WNOHANG) == hubs[i].pid) {
+				hubs[i].pid = 0;
+				die("hub " + str(i) + " died, see " + dir + "/hub" + str(i) + "/log");
+			}
+	}
+	for(int i = 0; i < k; ++i) {
+		double c = cpuTime(hubs[i].pid);
+		hubs[i].cpu = c < 0 || cpu[i] < 0 ? -1 : c - cpu[i];
+	}
+	stopHubs();
+
+	printf("%d hubs (%s), %d users, %d s after everybody saw everybody (%.1f s)\n",
+			k, layout.c_str(), m, secs, (warmed - start) / 1e6);
+	printf("rates per user per minute: %g INF, %g chat, %g search, %g CTM, %g quit; %lu dropped\n",
+			rates[0], rates[1], rates[2], rates[3], rates[4], (unsigned long)disconnects);
+	printf("\n%-4s %6s %12s %12s %6s %14s %14s %14s\n", "hub", "users", "to users",
+			"from users", "cpu s", "chat ms", "search ms", "ctm ms");
+	uint64_t toUsers = 0, onLinks = 0;
+	for(int i = 0; i < k; ++i) {
+		Hub& h = hubs[i];
+		char cpuStr[16];
+		if(h.cpu < 0)
+			strcpy(cpuStr, "-");
+		else
+			sprintf(cpuStr, "%.2f", h.cpu);
+		printf("%-4d %6d %12llu %12llu %6s %14s %14s %14s\n", i, h.users,
+				(unsigned long long)h.toUsers, (unsigned long long)h.fromUsers, cpuStr,
+				h.chat.str().c_str(), h.search.str().c_str(), h.ctm.str().c_str());
+		toUsers += h.toUsers;
+	}
+	printf("(latencies are average/99th percentile)\n");
+	if(!links.empty()) {
+		printf("\n%-7s %12s %12s %6s\n", "link", "a>b", "b>a", "downs");
+		for(size_t i = 0; i < links.size(); ++i) {
+			Link& l = links[i];
+			printf("%-7s %12llu %12llu %6d\n", (str(l.a) + "-" + str(l.b)).c_str(),
+					(unsigned long long)l.ab, (unsigned long long)l.ba, l.downs);
+			onLinks += l.ab + l.ba;
+		}
+	}
+	if(k > 1 && k <= 8) {
+		printf("\naverage chat ms, from row to column\n    ");
+		for(int j = 0; j < k; ++j)
+			printf(" %8d", j);
+		printf("\n");
+		for(int i = 0; i < k; ++i) {
+			printf("%-4d", i);
+			for(int j = 0; j < k; ++j) {
+				string s = matrix[i][j].str();
+				printf(" %8s", s.substr(0, s.find('/')).c_str());
+			}
+			printf("\n");
+		}
+	}
+	printf("\nper user per second: %.0f bytes from its hub, %.0f bytes on links\n",
+			double(toUsers) / m / secs, double(onLinks) / m / secs);
+	printf("hubs' files are in %s\n", dir.c_str());
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+// vim:ts=4:sw=4:noet
+/*
+ * Replays captured traffic (a --linefile log or plain ADC lines) in
+ * broadcast-sized batches, each compressed on its own the way the hub
+ * sends IZON ... IZOF batches, and reports size and CPU time against
+ * Z_BEST_COMPRESSION with no dictionary, which is what the hub does now.
+ */
+#include "capture.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace std;
+
+struct Result {
+	size_t out;
+	double cpu;
+};
+
+static Result run(const vector<string>& batches, int level, const string& dict, int rounds)
+{
+	z_stream zs;
+	zs.zalloc = NULL;
+	zs.zfree = NULL;
+	zs.opaque = NULL;
+	if(deflateInit(&zs, level) != Z_OK) {
+		cerr << "deflateInit failed" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	vector<Bytef> out;
+	Result r = { 0, 0 };
+	clock_t start = clock();
+	for(int n = 0; n < rounds; ++n) {
+		for(vector<string>::const_iterator i = batches.begin(); i != batches.end(); ++i) {
+			deflateReset(&zs);
+			if(!dict.empty())
+				deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(dict.data()), dict.size());
+			out.resize(deflateBound(&zs, i->size()));
+			zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(i->data()));
+			zs.avail_in = i->size();
+			zs.next_out = &out[0];
+			zs.avail_out = out.size();
+			if(deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+				cerr << "deflate failed" << endl;
+				exit(EXIT_FAILURE);
+			}
+			if(n == 0)
+				r.out += out.size() - zs.avail_out;
+		}
+	}
+	r.cpu = double(clock() - start) / CLOCKS_PER_SEC / rounds;
+	deflateEnd(&zs);
+	return r;
+}
+
+static void usage()
+{
+	cerr << "usage: qhub-zbench [-b lines per batch] [-r rounds] capture [dictionary]" << endl;
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+	size_t batchLines = 20;
+	int rounds = 5;
+	int c;
+	while((c = getopt(argc, argv, "b:r:")) != -1) {
+		switch(c) {
+		case 'b':
+			batchLines = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if((argc - optind != 1 && argc - optind != 2) || batchLines == 0 || rounds <= 0)
+		usage();
+
+	ifstream f(argv[optind]);
+	if(!f.good()) {
+		cerr << "could not open " << argv[optind] << endl;
+		return EXIT_FAILURE;
+	}
+	string dict;
+	if(argc - optind == 2) {
+		ifstream d(argv[optind + 1], ios::binary);
+		dict.assign(istreambuf_iterator<char>(d), istreambuf_iterator<char>());
+	}
+
+	vector<string> batches(1);
+	size_t in = 0, n = 0;
+	string line;
+	while(nextLine(f, line)) {
+		if(n++ == batchLines) {
+			batches.push_back(string());
+			n = 1;
+		}
+		batches.back() += line;
+		batches.back() += '\n';
+		in += line.size() + 1;
+	}
+	if(in == 0) {
+		cerr << "no traffic in " << argv[optind] << endl;
+		return EXIT_FAILURE;
+	}
+
+	printf("%lu bytes in %lu batches of up to %lu lines\n",
+			(unsigned long)in, (unsigned long)batches.size(), (unsigned long)batchLines);
+	printf("%-8s %-6s %10s %7s %9s %8s\n", "level", "dict", "bytes", "ratio", "cpu (ms)", "vs now");
+
+	Result base = run(batches, Z_BEST_COMPRESSION, string(), rounds);
+	for(int level = 1; level <= 9; level += level == 1 ? 5 : 3) {
+		for(int d = 0; d <= (dict.empty() ? 0 : 1); ++d) {
+			Result r = d || level != Z_BEST_COMPRESSION ? run(batches, level, d ? dict : string(), rounds) : base;
+			printf("%-8d %-6s %10lu %6.1f%% %9.2f %7.0f%%\n", level, d ? "yes" : "no",
+					(unsigned long)r.out, 100.0 * r.out / in, r.cpu * 1000,
+					100.0 * r.out / base.out);
+		}
+	}
+	return EXIT_SUCCESS;
+}